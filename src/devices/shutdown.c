@@ -11,8 +11,12 @@
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "filesys/defrag.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/zswap.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -132,6 +136,10 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  defrag_print_stats ();
+#endif
+#ifdef VM
+  zswap_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
@@ -7,6 +7,9 @@
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#ifdef VM
+#include "vm/pagecache.h"
+#endif
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -172,6 +175,9 @@ timer_interrupt (struct intr_frame *args UNUSED)
 {
   ticks++;
   thread_tick ();
+#ifdef VM
+  pagecache_tick ();
+#endif
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -0,0 +1,154 @@
+#include "filesys/defrag.h"
+#include <debug.h>
+#include <stdio.h>
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+
+/* Whether the defragmenter thread was started. */
+static bool enabled;
+/* Whether a pass was requested since the last one started. */
+static bool pass_pending;
+/* Upped to request a pass over the file system. */
+static struct semaphore pass_sema;
+/* Held by the defragmenter while it relocates a file. */
+static struct lock defrag_lock;
+
+/* Statistics of the last complete pass. */
+static unsigned long long files_cnt;    /* # of files scanned. */
+static unsigned long long extents_cnt;  /* # of contiguous runs. */
+/* # of files relocated since startup. */
+static unsigned long long relocated_cnt;
+
+static void defragger (void *aux UNUSED);
+static void defrag_dir (struct file *dir, unsigned long long *files,
+                        unsigned long long *extents);
+
+/* Starts the defragmenter thread, which runs a first pass right
+   away.  It is scheduled like any other thread, but takes the file
+   system lock for one file at a time, so system calls only wait
+   for the file being relocated. */
+void
+defrag_init (void) 
+{
+  sema_init (&pass_sema, 0);
+  lock_init (&defrag_lock);
+  enabled = true;
+  pass_pending = true;
+  sema_up (&pass_sema);
+  thread_create ("defrag", PRI_MIN, defragger, NULL);
+}
+
+/* Requests another pass, after a file was written. */
+void
+defrag_notify (void) 
+{
+  if (enabled && !pass_pending) 
+    {
+      pass_pending = true;
+      sema_up (&pass_sema);
+    }
+}
+
+/* Waits for the defragmenter to finish relocating the current file
+   and stops it. */
+void
+defrag_done (void) 
+{
+  if (enabled)
+    lock_acquire (&defrag_lock);
+}
+
+/* Prints defragmentation statistics. */
+void
+defrag_print_stats (void) 
+{
+  if (!enabled)
+    return;
+  printf ("Defrag: %llu files in %llu extents, %llu files relocated\n",
+          files_cnt, extents_cnt, relocated_cnt);
+}
+
+/* Passes over all files of the file system whenever requested. */
+static void
+defragger (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      unsigned long long files = 0;
+      unsigned long long extents = 0;
+
+      sema_down (&pass_sema);
+      pass_pending = false;
+
+      lock_acquire (process_get_filesys_lock ());
+      struct file *root = dir_open_root ();
+      lock_release (process_get_filesys_lock ());
+      if (root == NULL)
+        continue;
+      defrag_dir (root, &files, &extents);
+      lock_acquire (process_get_filesys_lock ());
+      file_close (root);
+      lock_release (process_get_filesys_lock ());
+
+      files_cnt = files;
+      extents_cnt = extents;
+    }
+}
+
+/* Relocates the fragmented files in DIR and its subdirectories,
+   adding the number of files and the number of contiguous runs
+   their data is in afterwards to *FILES and *EXTENTS.  System calls
+   change directories and the free map while holding the file
+   system lock, so it is held while looking up and relocating each
+   file, and released in between. */
+static void
+defrag_dir (struct file *dir, unsigned long long *files,
+            unsigned long long *extents)
+{
+  struct lock *filesys_lock = process_get_filesys_lock ();
+  char name[NAME_MAX + 1];
+
+  for (;;) 
+    {
+      struct inode *inode;
+
+      lock_acquire (filesys_lock);
+      if (!dir_readdir (dir, name)) 
+        {
+          lock_release (filesys_lock);
+          break;
+        }
+      if (!dir_lookup (dir, name, &inode)) 
+        {
+          lock_release (filesys_lock);
+          continue;
+        }
+
+      if (inode_is_dir (inode)) 
+        {
+          struct file *subdir = file_open (inode);
+          lock_release (filesys_lock);
+          if (subdir != NULL)
+            defrag_dir (subdir, files, extents);
+          lock_acquire (filesys_lock);
+          file_close (subdir);
+          lock_release (filesys_lock);
+          continue;
+        }
+
+      size_t file_extents;
+      lock_acquire (&defrag_lock);
+      if (inode_defrag (inode, &file_extents))
+        relocated_cnt++;
+      lock_release (&defrag_lock);
+      inode_close (inode);
+      lock_release (filesys_lock);
+
+      (*files)++;
+      *extents += file_extents;
+    }
+}
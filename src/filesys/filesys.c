@@ -2,11 +2,15 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/defrag.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/path.h"
+#ifdef VM
+#include "vm/pagecache.h"
+#endif
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -29,6 +33,7 @@ filesys_init (bool format)
     do_format ();
 
   free_map_open ();
+  inode_start_reclaim ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -36,6 +41,8 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  defrag_done ();
+  inode_stop_reclaim ();
   free_map_close ();
 }
 
@@ -109,6 +116,43 @@ filesys_remove (const char *name)
   return dir_remove(file);
 }
 
+/* Creates a file at TARGET that is a copy of the file at SOURCE,
+   sharing its data blocks until either file is written.
+   Returns true if successful, false otherwise.
+   Fails if SOURCE doesn't exist or is a directory, if TARGET
+   already exists, or if internal memory allocation fails. */
+bool
+filesys_clone (const char *source, const char *target)
+{
+  struct file *source_file = path_get_file(source, false);
+  if (source_file == NULL) {
+    return false;
+  }
+  if (file_is_dir(source_file)) {
+    file_close(source_file);
+    return false;
+  }
+  struct file *target_file = path_create_file(target, false, 0);
+  if (target_file == NULL) {
+    file_close(source_file);
+    return false;
+  }
+#ifdef VM
+  // Data written through memory mappings must be in the shared blocks.
+  pagecache_sync(file_get_inode(source_file));
+#endif
+  bool success = inode_clone(file_get_inode(target_file), 
+                             file_get_inode(source_file));
+  file_close(source_file);
+  if (!success) {
+    // Don't leave an empty file behind.
+    dir_remove(target_file);
+    return false;
+  }
+  file_close(target_file);
+  return true;
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
@@ -117,6 +161,7 @@ do_format (void)
   free_map_create ();
   if (!inode_create (ROOT_DIR_SECTOR, 0, true, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
+  inode_create_orphans ();
   free_map_close ();
   printf ("done.\n");
 }
@@ -7,6 +7,8 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define REF_MAP_SECTOR 2        /* Block reference count inode sector. */
+#define ORPHAN_SECTOR 3         /* Removed inodes not yet reclaimed. */
 
 /* Block device that contains the file system. */
 extern struct block *fs_device;
@@ -18,5 +20,6 @@ bool filesys_create_dir (const char *path, off_t initial_size);
 struct file *filesys_open_dir (const char *path);
 struct file *filesys_open (const char *path);
 bool filesys_remove (const char *name);
+bool filesys_clone (const char *source, const char *target);
 
 #endif /* filesys/filesys.h */
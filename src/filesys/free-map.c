@@ -4,9 +4,29 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static bool free_map_dirty;          /* Released sectors not yet written. */
+
+/* Held while the free map is changed or written.  A thread that
+   already holds it, inside a batch or while writing the free map,
+   defers writing to the outermost holder. */
+static struct lock free_map_lock;
+
+/* Reference counts of sectors shared between cloned files, counting
+   the references beyond the first, so unshared sectors are 0. */
+static struct file *ref_map_file;    /* Reference count file. */
+static uint16_t *ref_map;            /* Extra references, per sector. */
+static size_t ref_dirty_start;       /* First sector not yet flushed. */
+static size_t ref_dirty_end;         /* One past last sector not flushed. */
+
+static void ref_map_mark_dirty (block_sector_t);
+static bool free_map_lock_acquire (void);
+static void free_map_lock_release (bool acquired);
+static void free_map_write (void);
 
 /* Initializes the free map. */
 void
@@ -17,6 +37,15 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_mark (free_map, REF_MAP_SECTOR);
+  bitmap_mark (free_map, ORPHAN_SECTOR);
+  free_map_dirty = false;
+  lock_init (&free_map_lock);
+
+  ref_map = calloc (block_size (fs_device), sizeof *ref_map);
+  if (ref_map == NULL)
+    PANIC ("reference count creation failed");
+  ref_dirty_start = ref_dirty_end = 0;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -27,8 +56,10 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
+  bool acquired = free_map_lock_acquire ();
   block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector == FREE_MAP_SECTOR || sector == ROOT_DIR_SECTOR) {
+  if (sector == FREE_MAP_SECTOR || sector == ROOT_DIR_SECTOR
+      || sector == REF_MAP_SECTOR || sector == ORPHAN_SECTOR) {
     PANIC ("Bad free map allocation!");
   }
   if (sector != BITMAP_ERROR
@@ -38,18 +69,139 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
       bitmap_set_multiple (free_map, sector, cnt, false); 
       sector = BITMAP_ERROR;
     }
+  free_map_lock_release (acquired);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Makes CNT sectors starting at SECTOR available for use.
+   Sectors shared with a cloned file only lose a reference, which
+   is written to disk along with the next freed sector or flush,
+   so unsharing a block on each write to a clone costs no extra
+   write.  A crash can then only leak the sector.
+   Inside a batch, the change is written by free_map_end_batch(). */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  size_t i;
+
+  bool acquired = free_map_lock_acquire ();
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  for (i = 0; i < cnt; i++)
+    if (ref_map[sector + i] > 0) 
+      {
+        ref_map[sector + i]--;
+        ref_map_mark_dirty (sector + i);
+      }
+    else 
+      {
+        bitmap_reset (free_map, sector + i);
+        free_map_dirty = true;
+      }
+  if (acquired && free_map_dirty)
+    free_map_write ();
+  free_map_lock_release (acquired);
+}
+
+/* Starts a batch of releases, which are written to disk only once
+   by the matching free_map_end_batch().  Other threads can't change
+   the free map until the batch ends. */
+void
+free_map_begin_batch (void)
+{
+  lock_acquire (&free_map_lock);
+}
+
+/* Writes the releases of the current batch to disk and ends it. */
+void
+free_map_end_batch (void)
+{
+  free_map_write ();
+  lock_release (&free_map_lock);
+}
+
+/* Adds a reference to the allocated SECTOR, which is now shared
+   by one more file.  The reference is only written to disk by
+   free_map_flush(). */
+void
+free_map_ref (block_sector_t sector)
+{
+  bool acquired = free_map_lock_acquire ();
+  ASSERT (bitmap_test (free_map, sector));
+  ASSERT (ref_map[sector] < UINT16_MAX);
+  ref_map[sector]++;
+  ref_map_mark_dirty (sector);
+  free_map_lock_release (acquired);
+}
+
+/* Returns true if SECTOR is shared by more than one file. */
+bool
+free_map_is_shared (block_sector_t sector)
+{
+  return ref_map[sector] > 0;
+}
+
+/* Writes any changed reference counts to disk. */
+void
+free_map_flush (void)
+{
+  bool acquired = free_map_lock_acquire ();
+  if (ref_dirty_start < ref_dirty_end && ref_map_file != NULL) 
+    {
+      off_t size = (ref_dirty_end - ref_dirty_start) * sizeof *ref_map;
+      off_t ofs = ref_dirty_start * sizeof *ref_map;
+      if (file_write_at (ref_map_file, ref_map + ref_dirty_start, size, ofs)
+          == size)
+        ref_dirty_start = ref_dirty_end = 0;
+    }
+  free_map_lock_release (acquired);
+}
+
+/* Writes released sectors and changed reference counts to disk. */
+static void
+free_map_write (void)
+{
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+
+  if (free_map_dirty && free_map_file != NULL
+      && bitmap_write (free_map, free_map_file))
+    free_map_dirty = false;
+  free_map_flush ();
+}
+
+/* Acquires the free map lock unless the current thread already
+   holds it.  Returns true if it was acquired. */
+static bool
+free_map_lock_acquire (void)
+{
+  if (lock_held_by_current_thread (&free_map_lock))
+    return false;
+  lock_acquire (&free_map_lock);
+  return true;
+}
+
+/* Releases the free map lock if free_map_lock_acquire() ACQUIRED it. */
+static void
+free_map_lock_release (bool acquired)
+{
+  if (acquired)
+    lock_release (&free_map_lock);
+}
+
+/* Records that SECTOR's reference count needs to be written. */
+static void
+ref_map_mark_dirty (block_sector_t sector)
+{
+  if (ref_dirty_start >= ref_dirty_end) 
+    {
+      ref_dirty_start = sector;
+      ref_dirty_end = sector + 1;
+    }
+  else if (sector < ref_dirty_start)
+    ref_dirty_start = sector;
+  else if (sector >= ref_dirty_end)
+    ref_dirty_end = sector + 1;
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -61,13 +213,25 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+
+  off_t size = block_size (fs_device) * sizeof *ref_map;
+  ref_map_file = file_open (inode_open (REF_MAP_SECTOR));
+  if (ref_map_file == NULL)
+    PANIC ("can't open reference counts");
+  if (file_read_at (ref_map_file, ref_map, size, 0) != size)
+    PANIC ("can't read reference counts");
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  lock_acquire (&free_map_lock);
+  free_map_write ();
+  file_close (ref_map_file);
+  ref_map_file = NULL;
   file_close (free_map_file);
+  lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -88,4 +252,13 @@ free_map_create (void)
   // Only set free_map_file after the first write, since the sectors aren't
   // allocated before this.
   free_map_file = new_free_map_file;
+
+  /* Create the reference count file, which is sparse until a
+     file is cloned. */
+  if (!inode_create (REF_MAP_SECTOR, block_size (fs_device) * sizeof *ref_map,
+                     false, 0))
+    PANIC ("reference count creation failed");
+  ref_map_file = file_open (inode_open (REF_MAP_SECTOR));
+  if (ref_map_file == NULL)
+    PANIC ("can't open reference counts");
 }
@@ -13,5 +13,10 @@ void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+void free_map_begin_batch (void);
+void free_map_end_batch (void);
+void free_map_ref (block_sector_t);
+bool free_map_is_shared (block_sector_t);
+void free_map_flush (void);
 
 #endif /* filesys/free-map.h */
@@ -1,13 +1,19 @@
 #include "filesys/inode.h"
 #include <list.h>
 #include <debug.h>
+#include <lz4.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/defrag.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
 #include <stdio.h>
 #include "threads/synch.h"
+#include "threads/thread.h"
+#ifdef VM
+#include "vm/pagecache.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -25,6 +31,7 @@ struct inode_disk
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
     bool directory;                     /* If this inode is a directory. */
+    bool compressed;                    /* If data is in compressed clusters. */
     block_sector_t parent;              /* Parent directory. */
 
     /* Indexed file blocks. */
@@ -33,6 +40,22 @@ struct inode_disk
     block_sector_t double_indirect_block;
   };
 
+/* Compressed files store their data in clusters of CLUSTER_SIZE
+   bytes.  A cluster is kept in the sectors of its first N block
+   slots, and the rest of its slots are holes.  If N is
+   CLUSTER_SECTORS, they hold the data as is.  Otherwise, they start
+   with a 16 bit header holding the payload size, with CLUSTER_RAW
+   set if the payload is not compressed.  A cluster without any
+   sectors is all zeros.  Clusters are a page large, so that filling
+   a page cache page decompresses one cluster. */
+#define CLUSTER_SIZE 4096
+#define CLUSTER_SECTORS (CLUSTER_SIZE / BLOCK_SECTOR_SIZE)
+#define CLUSTER_RAW 0x8000
+#define CLUSTER_HEADER_SIZE 2
+/* Largest payload stored in fewer than CLUSTER_SECTORS sectors. */
+#define CLUSTER_PAYLOAD_MAX ((CLUSTER_SECTORS - 1) * BLOCK_SECTOR_SIZE \
+                             - CLUSTER_HEADER_SIZE)
+
 /* On-disk indirect data block.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct indirect_block
@@ -55,9 +78,24 @@ struct inode
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool relocating;                    /* Blocks being moved by defrag? */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    bool written;                       /* Written since it was opened? */
     struct inode_disk data;             /* Inode content. */
     struct lock lock;                   /* Filesystem lock for this inode. */
+    uint8_t *cluster;                   /* Last decompressed cluster. */
+    off_t cluster_ofs;                  /* Its offset, or -1 if invalid. */
+  };
+
+/* Number of removed inodes the orphan table can hold. */
+#define ORPHAN_CNT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* On-disk table of removed inodes whose blocks are not reclaimed
+   yet, stored at ORPHAN_SECTOR.  Free slots are 0.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct orphan_table
+  {
+    block_sector_t sectors[ORPHAN_CNT];
   };
 
 /* List of open inodes, so that opening a single inode twice
@@ -67,8 +105,24 @@ static struct list open_inodes;
 static void* bounce;
 /* A global lock to synchronize the inodes list. */
 static struct lock inodes_list_lock;
+/* Signaled when an inode's blocks finished being relocated. */
+static struct condition relocated_cond;
+/* In-memory copy of the orphan table, and its lock. */
+static struct orphan_table orphans;
+static struct lock orphans_lock;
+/* Signaled when an orphan is added to the table. */
+static struct condition orphans_cond;
+/* Held by the reclaimer thread while it reclaims an inode. */
+static struct lock reclaim_lock;
 
 static struct inode *_inode_reopen (struct inode *inode, bool owns_lock);
+static bool read_cached (struct inode *, void *, off_t size, off_t offset);
+static void write_cached (struct inode *, const void *, off_t size,
+                          off_t offset);
+static off_t compressed_read_at (struct inode *, uint8_t *, off_t size,
+                                 off_t offset);
+static off_t compressed_write_at (struct inode *, const uint8_t *,
+                                  off_t size, off_t offset);
 
 /* Initializes the inode module. */
 void
@@ -76,9 +130,41 @@ inode_init (void)
 {
   list_init (&open_inodes);
   lock_init (&inodes_list_lock);
+  cond_init (&relocated_cond);
   bounce = malloc (BLOCK_SECTOR_SIZE);
 }
 
+/* If the block at *SECTOR is shared with a cloned file, replaces it
+   with a private copy before it is written to.  The children of a
+   copied INDEX block stay shared, and each gain a reference.
+   Returns true if *SECTOR was changed. */
+static bool
+unshare_block (block_sector_t *sector, bool index)
+{
+  if (!free_map_is_shared (*sector))
+    return false;
+
+  block_sector_t copy;
+  struct indirect_block *block = malloc (BLOCK_SECTOR_SIZE);
+  if (block == NULL || !free_map_allocate (1, &copy)) 
+    {
+      free (block);
+      return false;
+    }
+  block_read (fs_device, *sector, block);
+  if (index)
+    for (size_t i = 0; i < INDIRECT_BLOCKS; i++)
+      if (block->blocks[i] != 0)
+        free_map_ref (block->blocks[i]);
+  block_write (fs_device, copy, block);
+  free (block);
+
+  /* Drops this file's reference to the shared block. */
+  free_map_release (*sector, 1);
+  *sector = copy;
+  return true;
+}
+
 static block_sector_t
 _byte_to_sector (struct inode_disk* data, off_t offset, bool create) {
   struct indirect_block* indirect_block = NULL;
@@ -96,6 +182,9 @@ _byte_to_sector (struct inode_disk* data, off_t offset, bool create) {
       free_map_allocate (1, direct_block_sector);
       memset (bounce, 0, BLOCK_SECTOR_SIZE);
       block_write (fs_device, *direct_block_sector, bounce);
+    } else if (create) {
+      // Copy the block before writing if it's shared with a clone.
+      unshare_block (direct_block_sector, false);
     }
     sector_idx = *direct_block_sector;
   } else if (index < DIRECT_BLOCKS + INDIRECT_BLOCKS) {
@@ -109,6 +198,9 @@ _byte_to_sector (struct inode_disk* data, off_t offset, bool create) {
       memset (indirect_block, 0, BLOCK_SECTOR_SIZE); 
       block_write (fs_device, data->indirect_block, indirect_block);
     } else {
+      if (create) {
+        unshare_block (&data->indirect_block, true);
+      }
       block_read (fs_device, data->indirect_block, indirect_block);
     }
     block_sector_t* direct_block_sector = &indirect_block->blocks[index];
@@ -121,6 +213,9 @@ _byte_to_sector (struct inode_disk* data, off_t offset, bool create) {
       memset (bounce, 0, BLOCK_SECTOR_SIZE);
       block_write (fs_device, *direct_block_sector, bounce);
 
+      // Update indirect block on disk.
+      block_write (fs_device, data->indirect_block, indirect_block);
+    } else if (create && unshare_block (direct_block_sector, false)) {
       // Update indirect block on disk.
       block_write (fs_device, data->indirect_block, indirect_block);
     }
@@ -137,6 +232,9 @@ _byte_to_sector (struct inode_disk* data, off_t offset, bool create) {
       block_write (fs_device, data->double_indirect_block, 
         double_indirect_block);
     } else {
+      if (create) {
+        unshare_block (&data->double_indirect_block, true);
+      }
       block_read (fs_device, data->double_indirect_block, 
         double_indirect_block);
     }
@@ -157,6 +255,11 @@ _byte_to_sector (struct inode_disk* data, off_t offset, bool create) {
       block_write (fs_device, data->double_indirect_block, 
         double_indirect_block);
     } else {
+      if (create && unshare_block (indirect_block_sector, true)) {
+        // Update double indirect block on disk.
+        block_write (fs_device, data->double_indirect_block, 
+          double_indirect_block);
+      }
       block_read (fs_device, *indirect_block_sector, indirect_block);
     }
     size_t indirect_index = index % INDIRECT_BLOCKS;
@@ -171,6 +274,9 @@ _byte_to_sector (struct inode_disk* data, off_t offset, bool create) {
       memset (bounce, 0, BLOCK_SECTOR_SIZE);
       block_write (fs_device, *direct_block_sector, bounce);
 
+      // Update the indirect block on disk.
+      block_write (fs_device, *indirect_block_sector, indirect_block);
+    } else if (create && unshare_block (direct_block_sector, false)) {
       // Update the indirect block on disk.
       block_write (fs_device, *indirect_block_sector, indirect_block);
     }
@@ -183,6 +289,69 @@ release:
   return sector_idx; 
 }
 
+/* Releases the data block at byte OFFSET of DATA, if it has one,
+   leaving a hole.  Index blocks shared with a clone are copied
+   before they are changed. */
+static void
+_release_sector (struct inode_disk *data, off_t offset)
+{
+  struct indirect_block *block = NULL;
+  struct indirect_block *double_block = NULL;
+  block_sector_t *parent = NULL;
+  size_t index = offset / BLOCK_SECTOR_SIZE;
+
+  if (index < DIRECT_BLOCKS) 
+    {
+      if (data->direct_blocks[index] != 0) 
+        {
+          free_map_release (data->direct_blocks[index], 1);
+          data->direct_blocks[index] = 0;
+        }
+      return;
+    }
+
+  block = malloc (BLOCK_SECTOR_SIZE);
+  double_block = malloc (BLOCK_SECTOR_SIZE);
+  if (block == NULL || double_block == NULL)
+    goto release;
+  index -= DIRECT_BLOCKS;
+  if (index < INDIRECT_BLOCKS) 
+    {
+      if (data->indirect_block == 0)
+        goto release;
+      unshare_block (&data->indirect_block, true);
+      parent = &data->indirect_block;
+    }
+  else if (index - INDIRECT_BLOCKS < DOUBLE_INDIRECT_BLOCKS) 
+    {
+      index -= INDIRECT_BLOCKS;
+      if (data->double_indirect_block == 0)
+        goto release;
+      unshare_block (&data->double_indirect_block, true);
+      block_read (fs_device, data->double_indirect_block, double_block);
+      parent = &double_block->blocks[index / INDIRECT_BLOCKS];
+      if (*parent == 0)
+        goto release;
+      if (unshare_block (parent, true))
+        block_write (fs_device, data->double_indirect_block, double_block);
+      index %= INDIRECT_BLOCKS;
+    }
+  else
+    goto release;
+
+  block_read (fs_device, *parent, block);
+  if (block->blocks[index] != 0) 
+    {
+      free_map_release (block->blocks[index], 1);
+      block->blocks[index] = 0;
+      block_write (fs_device, *parent, block);
+    }
+
+release:
+  free (block);
+  free (double_block);
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns 0 if INODE does not contain data for a byte at offset
@@ -244,12 +413,20 @@ inode_open (block_sector_t sector)
   lock_acquire(&inodes_list_lock);
 
   /* Check whether this inode is already open. */
+ retry:
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
     {
       inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector) 
         {
+          /* Wait for its blocks to be relocated.  It may be closed
+             meanwhile, so look it up again. */
+          if (inode->relocating)
+            {
+              cond_wait (&relocated_cond, &inodes_list_lock);
+              goto retry;
+            }
           // If this inode is removed, this could return NULL.
           inode = _inode_reopen(inode, true); 
           goto release;
@@ -267,6 +444,10 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  inode->relocating = false;
+  inode->written = false;
+  inode->cluster = NULL;
+  inode->cluster_ofs = -1;
   lock_init (&inode->lock);
   block_read (fs_device, inode->sector, &inode->data);
 release:
@@ -311,6 +492,233 @@ inode_reopen (struct inode *inode)
   return _inode_reopen(inode, false);
 }
 
+/* Makes the empty file INODE a copy of SOURCE, sharing all of its
+   data and index blocks.  Shared blocks are copied on their first
+   write by either file, so cloning doesn't copy any data.
+   Returns true if successful. */
+bool
+inode_clone (struct inode *inode, struct inode *source)
+{
+  ASSERT (inode != NULL && source != NULL);
+  ASSERT (!inode_is_dir (inode) && !inode_is_dir (source));
+
+  if (inode_length (inode) != 0 || inode == source)
+    return false;
+
+  lock_acquire (&source->lock);
+  struct inode_disk *data = &inode->data;
+  struct inode_disk *source_data = &source->data;
+  data->length = source_data->length;
+  data->compressed = source_data->compressed;
+  for (size_t i = 0; i < DIRECT_BLOCKS; i++) 
+    {
+      data->direct_blocks[i] = source_data->direct_blocks[i];
+      if (data->direct_blocks[i] != 0)
+        free_map_ref (data->direct_blocks[i]);
+    }
+  data->indirect_block = source_data->indirect_block;
+  if (data->indirect_block != 0)
+    free_map_ref (data->indirect_block);
+  data->double_indirect_block = source_data->double_indirect_block;
+  if (data->double_indirect_block != 0)
+    free_map_ref (data->double_indirect_block);
+  free_map_flush ();
+  lock_release (&source->lock);
+
+  block_write (fs_device, inode->sector, data);
+  return true;
+}
+
+/* Called by for_each_index_block() with the CNT block pointers in
+   BLOCKS of the index block INDEX at sector INDEX_SECTOR, which is
+   the inode itself for its direct blocks.  Returns false to stop. */
+typedef bool index_block_func (block_sector_t *blocks, size_t cnt,
+                               block_sector_t index_sector, void *index,
+                               void *aux);
+
+/* Calls FUNC for each index block of INODE that points to data
+   blocks, in file order, until it returns false. */
+static void
+for_each_index_block (struct inode *inode, index_block_func *func,
+                      void *aux)
+{
+  struct inode_disk *data = &inode->data;
+  struct indirect_block *block = malloc (BLOCK_SECTOR_SIZE);
+  struct indirect_block *double_block = malloc (BLOCK_SECTOR_SIZE);
+  if (block == NULL || double_block == NULL)
+    goto release;
+
+  if (!func (data->direct_blocks, DIRECT_BLOCKS, inode->sector, data, aux))
+    goto release;
+  if (data->indirect_block != 0) 
+    {
+      block_read (fs_device, data->indirect_block, block);
+      if (!func (block->blocks, INDIRECT_BLOCKS, data->indirect_block,
+                 block, aux))
+        goto release;
+    }
+  if (data->double_indirect_block != 0) 
+    {
+      block_read (fs_device, data->double_indirect_block, double_block);
+      for (size_t i = 0; i < INDIRECT_BLOCKS; i++) 
+        {
+          block_sector_t sector = double_block->blocks[i];
+          if (sector == 0)
+            continue;
+          block_read (fs_device, sector, block);
+          if (!func (block->blocks, INDIRECT_BLOCKS, sector, block, aux))
+            goto release;
+        }
+    }
+
+release:
+  free (block);
+  free (double_block);
+}
+
+/* Layout of an inode's data blocks, found by scan_index_block(). */
+struct block_layout
+  {
+    size_t blocks;                      /* Number of data blocks. */
+    size_t extents;                     /* Number of contiguous runs. */
+    block_sector_t last;                /* Last data block seen. */
+    bool shared;                        /* Shares blocks with a clone? */
+  };
+
+static bool
+scan_index_block (block_sector_t *blocks, size_t cnt,
+                  block_sector_t index_sector, void *index UNUSED,
+                  void *layout_)
+{
+  struct block_layout *layout = layout_;
+
+  if (free_map_is_shared (index_sector))
+    layout->shared = true;
+  for (size_t i = 0; i < cnt; i++) 
+    {
+      if (blocks[i] == 0)
+        continue;
+      if (free_map_is_shared (blocks[i]))
+        layout->shared = true;
+      if (layout->blocks == 0 || blocks[i] != layout->last + 1)
+        layout->extents++;
+      layout->last = blocks[i];
+      layout->blocks++;
+    }
+  return true;
+}
+
+/* State of relocating an inode's data blocks into a free run. */
+struct relocation
+  {
+    struct inode *inode;                /* The inode being relocated. */
+    block_sector_t next;                /* Next sector of the free run. */
+    block_sector_t end;                 /* Sector past the free run. */
+    void *buffer;                       /* Sector sized copy buffer. */
+  };
+
+/* Copies the data blocks of one index block to the next sectors of
+   the free run and points the index block at the copies, before
+   releasing the old blocks.  Nobody else may have the inode open,
+   since they could be reading or writing the old blocks, so this
+   stops once someone else opened it, and keeps others from opening
+   it until the index block is relocated. */
+static bool
+relocate_index_block (block_sector_t *blocks, size_t cnt,
+                      block_sector_t index_sector, void *index,
+                      void *relocation_)
+{
+  struct relocation *r = relocation_;
+  struct indirect_block old;
+
+  lock_acquire (&inodes_list_lock);
+  if (r->inode->open_cnt != 1 || r->inode->removed)
+    {
+      lock_release (&inodes_list_lock);
+      return false;
+    }
+  r->inode->relocating = true;
+  lock_release (&inodes_list_lock);
+
+#ifdef VM
+  /* Cached pages would be written back to the old blocks. */
+  pagecache_drop_inode (r->inode);
+#endif
+  /* Someone could have changed the index block since it was read. */
+  if (index != &r->inode->data)
+    block_read (fs_device, index_sector, index);
+
+  /* The file may have grown since the run was allocated, so stop
+     instead of copying past the run into other files' sectors. */
+  size_t used = 0;
+  for (size_t i = 0; i < cnt; i++)
+    if (blocks[i] != 0)
+      used++;
+  bool fits = used <= r->end - r->next;
+
+  if (fits) 
+    {
+      for (size_t i = 0; i < cnt; i++) 
+        {
+          old.blocks[i] = blocks[i];
+          if (blocks[i] == 0)
+            continue;
+          block_read (fs_device, blocks[i], r->buffer);
+          block_write (fs_device, r->next, r->buffer);
+          blocks[i] = r->next++;
+        }
+      /* A single sector write switches all pointers at once. */
+      block_write (fs_device, index_sector, index);
+
+      free_map_begin_batch ();
+      for (size_t i = 0; i < cnt; i++)
+        if (old.blocks[i] != 0)
+          free_map_release (old.blocks[i], 1);
+      free_map_end_batch ();
+    }
+
+  lock_acquire (&inodes_list_lock);
+  r->inode->relocating = false;
+  cond_broadcast (&relocated_cond, &inodes_list_lock);
+  lock_release (&inodes_list_lock);
+  return fits;
+}
+
+/* Relocates the data blocks of INODE into one contiguous run of free
+   sectors, if they are spread over several runs.  Files sharing
+   blocks with a clone are left alone.  Stores the number of runs
+   the data blocks are in afterwards into *EXTENTS.
+   Returns true if the data blocks were relocated. */
+bool
+inode_defrag (struct inode *inode, size_t *extents)
+{
+  struct block_layout layout = { 0, 0, 0, false };
+  struct relocation r;
+  block_sector_t start;
+
+  for_each_index_block (inode, scan_index_block, &layout);
+  *extents = layout.extents;
+  if (layout.extents <= 1 || layout.shared
+      || !free_map_allocate (layout.blocks, &start))
+    return false;
+
+  r.inode = inode;
+  r.next = start;
+  r.end = start + layout.blocks;
+  r.buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (r.buffer != NULL)
+    for_each_index_block (inode, relocate_index_block, &r);
+  free (r.buffer);
+
+  /* Release the part of the run that wasn't used, if stopped. */
+  if (r.next < r.end)
+    free_map_release (r.next, r.end - r.next);
+  if (r.next == start)
+    return false;
+  *extents = r.next == r.end ? 1 : layout.extents;
+  return true;
+}
+
 /* Returns INODE's inode number. */
 block_sector_t
 inode_get_inumber (const struct inode *inode)
@@ -318,45 +726,177 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Frees the blocks below the index block at SECTOR, which is DEPTH
+   levels above the data blocks, one batch per index block.  Freed
+   children are cleared in the index block on disk before the free
+   map is written, so a crash can leak blocks but never free them
+   twice.  If the index block is shared with a cloned file, its
+   children stay referenced through the other copy. */
 static void
-_release_all_blocks(struct inode* inode) {
-  // TODO Only clear up to the length of the file!
-  // size_t length = inode->data.length;
-  // size_t sectors = bytes_to_sectors(length);
+reclaim_indirect_block (block_sector_t sector, int depth)
+{
+  struct indirect_block block;
 
-  // Free all direct, indirect, and double direct blocks.
-  for (size_t i = 0; i < DIRECT_BLOCKS; i++) {
-    if (inode->data.direct_blocks[i] != 0) {
-      free_map_release (inode->data.direct_blocks[i], 1);
+  if (free_map_is_shared (sector))
+    return;
+  block_read (fs_device, sector, &block);
+  if (depth > 1) 
+    {
+      for (size_t i = 0; i < INDIRECT_BLOCKS; i++) 
+        {
+          if (block.blocks[i] == 0)
+            continue;
+          reclaim_indirect_block (block.blocks[i], depth - 1);
+          free_map_begin_batch ();
+          free_map_release (block.blocks[i], 1);
+          block.blocks[i] = 0;
+          block_write (fs_device, sector, &block);
+          free_map_end_batch ();
+        }
+      return;
     }
-  }
-  if (inode->data.indirect_block != 0) {
-    struct indirect_block indirect_block;
-    block_read (fs_device, inode->data.indirect_block, &indirect_block);
-    for (size_t i = 0; i < INDIRECT_BLOCKS; i++) {
-      if (indirect_block.blocks[i] != 0) {
-        free_map_release (indirect_block.blocks[i], 1);
+
+  free_map_begin_batch ();
+  for (size_t i = 0; i < INDIRECT_BLOCKS; i++)
+    if (block.blocks[i] != 0)
+      {
+        free_map_release (block.blocks[i], 1);
+        block.blocks[i] = 0;
       }
-    }
-    free_map_release (inode->data.indirect_block, 1);
-  }
-  if (inode->data.double_indirect_block != 0) {
-    struct indirect_block double_indirect_block;
-    block_read (fs_device, inode->data.double_indirect_block, &double_indirect_block);
-    for (size_t i = 0; i < INDIRECT_BLOCKS; i++) {
-      if (double_indirect_block.blocks[i] != 0) {
-        struct indirect_block indirect_block;
-        block_read (fs_device, double_indirect_block.blocks[i], &indirect_block);
-        for (size_t j = 0; j < INDIRECT_BLOCKS; j++) {
-          if (indirect_block.blocks[j] != 0) {
-            free_map_release (indirect_block.blocks[j], 1);
+  block_write (fs_device, sector, &block);
+  free_map_end_batch ();
+}
+
+/* Frees the removed inode at SECTOR and all of its blocks, then
+   clears its SLOT in the orphan table, unless SLOT is -1. */
+static void
+reclaim_inode (block_sector_t sector, int slot)
+{
+  struct inode_disk data;
+
+  block_read (fs_device, sector, &data);
+  if (data.magic == INODE_MAGIC) 
+    {
+      free_map_begin_batch ();
+      for (size_t i = 0; i < DIRECT_BLOCKS; i++)
+        if (data.direct_blocks[i] != 0) 
+          {
+            free_map_release (data.direct_blocks[i], 1);
+            data.direct_blocks[i] = 0;
           }
+      block_write (fs_device, sector, &data);
+      free_map_end_batch ();
+
+      if (data.indirect_block != 0) 
+        {
+          reclaim_indirect_block (data.indirect_block, 1);
+          free_map_begin_batch ();
+          free_map_release (data.indirect_block, 1);
+          data.indirect_block = 0;
+          block_write (fs_device, sector, &data);
+          free_map_end_batch ();
         }
-        free_map_release (double_indirect_block.blocks[i], 1);
+      if (data.double_indirect_block != 0) 
+        {
+          reclaim_indirect_block (data.double_indirect_block, 2);
+          free_map_begin_batch ();
+          free_map_release (data.double_indirect_block, 1);
+          data.double_indirect_block = 0;
+          block_write (fs_device, sector, &data);
+          free_map_end_batch ();
+        }
+    }
+
+  /* Clear the slot before the free map is written, so a crash
+     can't reclaim the inode sector again once it is reused. */
+  free_map_begin_batch ();
+  free_map_release (sector, 1);
+  if (slot >= 0) 
+    {
+      lock_acquire (&orphans_lock);
+      orphans.sectors[slot] = 0;
+      block_write (fs_device, ORPHAN_SECTOR, &orphans);
+      lock_release (&orphans_lock);
+    }
+  free_map_end_batch ();
+}
+
+/* Records the removed inode at SECTOR in the orphan table, to be
+   reclaimed by the reclaimer thread.  Returns false if the table
+   is full. */
+static bool
+record_orphan (block_sector_t sector)
+{
+  bool success = false;
+
+  lock_acquire (&orphans_lock);
+  for (size_t i = 0; i < ORPHAN_CNT; i++)
+    if (orphans.sectors[i] == 0) 
+      {
+        orphans.sectors[i] = sector;
+        block_write (fs_device, ORPHAN_SECTOR, &orphans);
+        cond_signal (&orphans_cond, &orphans_lock);
+        success = true;
+        break;
       }
+  lock_release (&orphans_lock);
+  return success;
+}
+
+/* Reclaims the orphans in the orphan table, one at a time. */
+static void
+reclaimer (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      int slot = -1;
+
+      lock_acquire (&orphans_lock);
+      while (slot < 0) 
+        {
+          for (size_t i = 0; i < ORPHAN_CNT && slot < 0; i++)
+            if (orphans.sectors[i] != 0)
+              slot = i;
+          if (slot < 0)
+            cond_wait (&orphans_cond, &orphans_lock);
+        }
+      block_sector_t sector = orphans.sectors[slot];
+      lock_release (&orphans_lock);
+
+      lock_acquire (&reclaim_lock);
+      reclaim_inode (sector, slot);
+      lock_release (&reclaim_lock);
     }
-    free_map_release (inode->data.double_indirect_block, 1);
-  }
+}
+
+/* Reads the orphan table, which still lists any inodes that were
+   being reclaimed during a crash, and starts the reclaimer thread.
+   Must be called after the free map is opened. */
+void
+inode_start_reclaim (void)
+{
+  lock_init (&orphans_lock);
+  cond_init (&orphans_cond);
+  lock_init (&reclaim_lock);
+  block_read (fs_device, ORPHAN_SECTOR, &orphans);
+  thread_create ("reclaimer", PRI_DEFAULT, reclaimer, NULL);
+}
+
+/* Waits for the reclaimer thread to finish the inode it is
+   reclaiming and stops it.  Orphans that are left are reclaimed
+   the next time the file system is mounted. */
+void
+inode_stop_reclaim (void)
+{
+  lock_acquire (&reclaim_lock);
+}
+
+/* Writes an empty orphan table to disk, while formatting. */
+void
+inode_create_orphans (void)
+{
+  static struct orphan_table empty;
+  block_write (fs_device, ORPHAN_SECTOR, &empty);
 }
 
 /* Closes INODE and writes it to disk.
@@ -378,17 +918,27 @@ inode_close (struct inode *inode)
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
       lock_release(&inodes_list_lock); 
+
+#ifdef VM
+      /* Nothing maps the inode anymore, drop its cached pages. */
+      pagecache_drop_inode (inode);
+#endif
  
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed, in the background unless
+         too many inodes are waiting already. */
       if (inode->removed) 
         {
-          free_map_release (inode->sector, 1);
-          _release_all_blocks(inode);
+          if (!record_orphan (inode->sector))
+            reclaim_inode (inode->sector, -1);
         } else { 
+          /* Writes may have fragmented it. */
+          if (inode->written)
+            defrag_notify ();
           /* Write to disk. */
           // block_write (fs_device, inode->sector, &inode->data);
       }
 
+      free (inode->cluster);
       free (inode); 
     }
   else {
@@ -407,6 +957,349 @@ inode_remove (struct inode *inode)
   lock_release(&inodes_list_lock);
 }
 
+/* Loads the cluster at OFFSET of the compressed INODE into its
+   cluster buffer, unless it is there already.
+   Returns true if successful. */
+static bool
+load_cluster (struct inode *inode, off_t offset)
+{
+  block_sector_t sectors[CLUSTER_SECTORS];
+  uint8_t *stored = NULL;
+  size_t cnt;
+  bool success = false;
+
+  ASSERT (lock_held_by_current_thread (&inode->lock));
+  ASSERT (offset % CLUSTER_SIZE == 0);
+
+  if (inode->cluster_ofs == offset)
+    return true;
+  if (inode->cluster == NULL)
+    {
+      inode->cluster = malloc (CLUSTER_SIZE);
+      if (inode->cluster == NULL)
+        return false;
+    }
+  inode->cluster_ofs = -1;
+
+  for (cnt = 0; cnt < CLUSTER_SECTORS; cnt++) 
+    {
+      sectors[cnt] = _byte_to_sector (&inode->data,
+                                      offset + cnt * BLOCK_SECTOR_SIZE,
+                                      false);
+      if (sectors[cnt] == 0)
+        break;
+    }
+
+  size_t length = 0;
+  if (cnt == CLUSTER_SECTORS) 
+    {
+      for (size_t i = 0; i < cnt; i++)
+        block_read (fs_device, sectors[i],
+                    inode->cluster + i * BLOCK_SECTOR_SIZE);
+      length = CLUSTER_SIZE;
+    }
+  else if (cnt > 0) 
+    {
+      stored = malloc (cnt * BLOCK_SECTOR_SIZE);
+      if (stored == NULL)
+        goto release;
+      for (size_t i = 0; i < cnt; i++)
+        block_read (fs_device, sectors[i], stored + i * BLOCK_SECTOR_SIZE);
+
+      uint16_t header = stored[0] | (stored[1] << 8);
+      size_t size = header & ~CLUSTER_RAW;
+      if (size > cnt * BLOCK_SECTOR_SIZE - CLUSTER_HEADER_SIZE)
+        goto release;
+      if (header & CLUSTER_RAW) 
+        {
+          memcpy (inode->cluster, stored + CLUSTER_HEADER_SIZE, size);
+          length = size;
+        }
+      else 
+        {
+          length = lz4_decompress (stored + CLUSTER_HEADER_SIZE, size,
+                                   inode->cluster, CLUSTER_SIZE);
+          if (length == 0)
+            goto release;
+        }
+    }
+  memset (inode->cluster + length, 0, CLUSTER_SIZE - length);
+  inode->cluster_ofs = offset;
+  success = true;
+
+release:
+  free (stored);
+  return success;
+}
+
+/* Stores the first SIZE bytes of the cluster buffer of the
+   compressed INODE as its cluster at OFFSET, compressed if that
+   takes fewer sectors.  Returns true if successful. */
+static bool
+store_cluster (struct inode *inode, off_t offset, off_t size)
+{
+  uint8_t *buffer = malloc (CLUSTER_HEADER_SIZE + CLUSTER_PAYLOAD_MAX);
+  void *work = malloc (LZ4_WORK_SIZE);
+  const uint8_t *stored = buffer;
+  size_t cnt = 0;
+  bool success = false;
+
+  ASSERT (lock_held_by_current_thread (&inode->lock));
+  ASSERT (inode->cluster_ofs == offset);
+
+  if (buffer == NULL || work == NULL)
+    goto release;
+
+  /* All zero clusters are holes. */
+  for (off_t i = 0; i < size; i++)
+    if (inode->cluster[i] != 0) 
+      {
+        cnt = CLUSTER_SECTORS;
+        break;
+      }
+
+  if (cnt > 0) 
+    {
+      uint8_t *payload = buffer + CLUSTER_HEADER_SIZE;
+      uint16_t header = lz4_compress (inode->cluster, size, payload,
+                                      CLUSTER_PAYLOAD_MAX, work);
+      if ((header == 0 || header >= size) && size <= CLUSTER_PAYLOAD_MAX) 
+        {
+          memcpy (payload, inode->cluster, size);
+          header = size | CLUSTER_RAW;
+        }
+      if (header == 0)
+        stored = inode->cluster;
+      else 
+        {
+          size_t stored_size = (header & ~CLUSTER_RAW) + CLUSTER_HEADER_SIZE;
+          buffer[0] = header & 0xff;
+          buffer[1] = header >> 8;
+          cnt = DIV_ROUND_UP (stored_size, BLOCK_SECTOR_SIZE);
+          memset (buffer + stored_size, 0,
+                  cnt * BLOCK_SECTOR_SIZE - stored_size);
+        }
+    }
+
+  for (size_t i = 0; i < cnt; i++) 
+    {
+      block_sector_t sector = _byte_to_sector (&inode->data,
+                                               offset + i * BLOCK_SECTOR_SIZE,
+                                               true);
+      if (sector == 0)
+        goto release;
+      block_write (fs_device, sector, stored + i * BLOCK_SECTOR_SIZE);
+    }
+  for (size_t i = cnt; i < CLUSTER_SECTORS; i++)
+    _release_sector (&inode->data, offset + i * BLOCK_SECTOR_SIZE);
+  success = true;
+
+release:
+  block_write (fs_device, inode->sector, &inode->data);
+  free (buffer);
+  free (work);
+  return success;
+}
+
+/* Reads SIZE bytes at OFFSET from the compressed INODE into
+   BUFFER, like inode_read_at().  Data is copied out of the cluster
+   buffer through a bounce buffer, since BUFFER may fault while the
+   inode is locked. */
+static off_t
+compressed_read_at (struct inode *inode, uint8_t *buffer, off_t size,
+                    off_t offset)
+{
+  off_t bytes_read = 0;
+  uint8_t *bounce = NULL;
+
+  while (size > 0) 
+    {
+      /* Starting byte offset within cluster. */
+      off_t cluster_ofs = offset % CLUSTER_SIZE;
+
+      /* Bytes left in inode, bytes left in cluster, lesser of the two. */
+      off_t inode_left = inode_length (inode) - offset;
+      off_t cluster_left = CLUSTER_SIZE - cluster_ofs;
+      off_t min_left = inode_left < cluster_left ? inode_left : cluster_left;
+
+      /* Number of bytes to actually copy out of this cluster. */
+      off_t chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      if (!read_cached (inode, buffer + bytes_read, chunk_size, offset)) 
+        {
+          if (bounce == NULL) 
+            {
+              bounce = malloc (CLUSTER_SIZE);
+              if (bounce == NULL)
+                break;
+            }
+          lock_acquire (&inode->lock);
+          bool success = load_cluster (inode, offset - cluster_ofs);
+          if (success)
+            memcpy (bounce, inode->cluster + cluster_ofs, chunk_size);
+          lock_release (&inode->lock);
+          if (!success)
+            break;
+          memcpy (buffer + bytes_read, bounce, chunk_size);
+        }
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+  free (bounce);
+
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER at OFFSET into the compressed
+   INODE, like inode_write_at(), recompressing each cluster that is
+   written to. */
+static off_t
+compressed_write_at (struct inode *inode, const uint8_t *buffer, off_t size,
+                     off_t offset)
+{
+  off_t bytes_written = 0;
+  uint8_t *bounce = malloc (CLUSTER_SIZE);
+
+  if (bounce == NULL)
+    return 0;
+  while (size > 0) 
+    {
+      /* Starting byte offset within cluster. */
+      off_t cluster_ofs = offset % CLUSTER_SIZE;
+      off_t cluster_start = offset - cluster_ofs;
+
+      /* Bytes in max file size, bytes left in cluster, lesser of the two. */
+      off_t inode_left = MAX_FILE_SIZE - offset;
+      off_t cluster_left = CLUSTER_SIZE - cluster_ofs;
+      off_t min_left = inode_left < cluster_left ? inode_left : cluster_left;
+
+      /* Number of bytes to actually write into this cluster. */
+      off_t chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      /* BUFFER may fault, so copy it before locking the inode. */
+      memcpy (bounce, buffer + bytes_written, chunk_size);
+
+      lock_acquire (&inode->lock);
+      off_t end = inode_length (inode);
+      if (end < offset + chunk_size)
+        end = offset + chunk_size;
+      if (end > cluster_start + CLUSTER_SIZE)
+        end = cluster_start + CLUSTER_SIZE;
+      bool success = load_cluster (inode, cluster_start);
+      if (success) 
+        {
+          memcpy (inode->cluster + cluster_ofs, bounce, chunk_size);
+          success = store_cluster (inode, cluster_start, end - cluster_start);
+          if (!success)
+            inode->cluster_ofs = -1;
+        }
+      lock_release (&inode->lock);
+      if (!success)
+        break;
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_written += chunk_size;
+    }
+  free (bounce);
+
+  return bytes_written;
+}
+
+/* Switches INODE between storing its data as is and storing it in
+   compressed clusters, converting the data it already has.  Fails
+   for directories.  Returns true if successful. */
+bool
+inode_set_compressed (struct inode *inode, bool compressed)
+{
+  uint8_t *buffer;
+  bool success = true;
+
+  if (inode_is_dir (inode))
+    return false;
+  buffer = malloc (CLUSTER_SIZE);
+  if (buffer == NULL)
+    return false;
+
+  lock_acquire (&inode->lock);
+  if (inode->data.compressed == compressed)
+    goto release;
+
+  /* Converting a cluster reads all of it before writing it back in
+     the other format, so it can reuse the same block slots. */
+  off_t length = inode_length (inode);
+  for (off_t offset = 0; offset < length && success; offset += CLUSTER_SIZE) 
+    {
+      off_t size = length - offset < CLUSTER_SIZE ? length - offset
+                                                  : CLUSTER_SIZE;
+      size_t cnt = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+      if (compressed) 
+        {
+          for (size_t i = 0; i < cnt; i++) 
+            {
+              off_t sector_ofs = offset + i * BLOCK_SECTOR_SIZE;
+              block_sector_t sector = _byte_to_sector (&inode->data,
+                                                       sector_ofs, false);
+              if (sector != 0)
+                block_read (fs_device, sector,
+                            buffer + i * BLOCK_SECTOR_SIZE);
+              else
+                memset (buffer + i * BLOCK_SECTOR_SIZE, 0,
+                        BLOCK_SECTOR_SIZE);
+            }
+          if (inode->cluster == NULL)
+            inode->cluster = malloc (CLUSTER_SIZE);
+          if (inode->cluster == NULL)
+            success = false;
+          else 
+            {
+              memcpy (inode->cluster, buffer, size);
+              memset (inode->cluster + size, 0, CLUSTER_SIZE - size);
+              inode->cluster_ofs = offset;
+              success = store_cluster (inode, offset, size);
+            }
+        }
+      else 
+        {
+          success = load_cluster (inode, offset);
+          if (success)
+            memcpy (buffer, inode->cluster, CLUSTER_SIZE);
+          for (size_t i = 0; i < cnt && success; i++) 
+            {
+              block_sector_t sector;
+              sector = _byte_to_sector (&inode->data,
+                                        offset + i * BLOCK_SECTOR_SIZE, true);
+              if (sector == 0)
+                success = false;
+              else
+                block_write (fs_device, sector,
+                             buffer + i * BLOCK_SECTOR_SIZE);
+            }
+          /* A compressed cluster can use one slot past the data. */
+          for (size_t i = cnt; i < CLUSTER_SECTORS && success; i++)
+            _release_sector (&inode->data, offset + i * BLOCK_SECTOR_SIZE);
+        }
+    }
+
+  inode->cluster_ofs = -1;
+  if (success)
+    inode->data.compressed = compressed;
+  block_write (fs_device, inode->sector, &inode->data);
+
+release:
+  lock_release (&inode->lock);
+  free (buffer);
+  return success;
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
@@ -417,10 +1310,12 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
 
+  if (inode->data.compressed)
+    return compressed_read_at (inode, buffer, size, offset);
+
   while (size > 0) 
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector(inode, offset, false);
+      /* Starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE; 
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -433,6 +1328,12 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
+      /* Disk sector to read, unless the page cache has the data. */
+      block_sector_t sector_idx = 0;
+      if (read_cached (inode, buffer + bytes_read, chunk_size, offset))
+        goto advance;
+      sector_idx = byte_to_sector(inode, offset, false);
+
       if (sector_idx == 0) 
         {
           /* This sector of the file is sparse, fill with zeros. */
@@ -457,6 +1358,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
           memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
         }
       
+    advance:
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
@@ -478,11 +1380,19 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
+  off_t start = offset;
   uint8_t *bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
 
+  if (inode->data.compressed) 
+    {
+      bytes_written = compressed_write_at (inode, buffer, size, offset);
+      offset += bytes_written;
+      goto written;
+    }
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
@@ -534,7 +1444,13 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
+ written:
   free (bounce);
+  if (bytes_written > 0)
+    inode->written = true;
+
+  /* Keep pages shared through the page cache up to date. */
+  write_cached (inode, buffer, bytes_written, start);
 
   // The file has grown, update its length.
   if (offset > inode_length (inode)) {
@@ -592,6 +1508,45 @@ inode_get_parent (const struct inode *inode)
   return inode_open(inode->data.parent);
 }
 
+#ifdef VM
+/* Returns true if INODE is the free map or the reference count
+   file.  These are never mapped, so the page cache never holds their
+   data, and they are written while the free map lock is held, which
+   must not wait for the page cache. */
+static bool
+is_map_inode (const struct inode *inode)
+{
+  return inode->sector == FREE_MAP_SECTOR || inode->sector == REF_MAP_SECTOR;
+}
+#endif
+
+/* Copies SIZE bytes at OFFSET in INODE into BUFFER from the page
+   cache, if the page is resident.  Returns true if successful. */
+static bool
+read_cached (struct inode *inode UNUSED, void *buffer UNUSED,
+             off_t size UNUSED, off_t offset UNUSED)
+{
+#ifdef VM
+  if (is_map_inode (inode))
+    return false;
+  return pagecache_read (inode, buffer, size, offset);
+#else
+  return false;
+#endif
+}
+
+/* Updates any page cache pages with the SIZE bytes in BUFFER that
+   were written at OFFSET in INODE. */
+static void
+write_cached (struct inode *inode UNUSED, const void *buffer UNUSED,
+              off_t size UNUSED, off_t offset UNUSED)
+{
+#ifdef VM
+  if (!is_map_inode (inode))
+    pagecache_write (inode, buffer, size, offset);
+#endif
+}
+
 bool
 inode_is_root (const struct inode *inode)
 {
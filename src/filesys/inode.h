@@ -8,6 +8,9 @@
 struct bitmap;
 
 void inode_init (void);
+void inode_create_orphans (void);
+void inode_start_reclaim (void);
+void inode_stop_reclaim (void);
 bool inode_create (block_sector_t, off_t, bool directory, 
     block_sector_t parent);
 struct inode *inode_open (block_sector_t);
@@ -15,6 +18,9 @@ struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_clone (struct inode *, struct inode *source);
+bool inode_defrag (struct inode *, size_t *extents);
+bool inode_set_compressed (struct inode *, bool compressed);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
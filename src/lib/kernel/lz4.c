@@ -0,0 +1,193 @@
+#include "lz4.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Shortest match that is encoded. */
+#define MIN_MATCH 4
+/* The last literals of a block, which are never part of a match. */
+#define LAST_LITERALS 5
+/* Matches must start this many bytes before the end of a block. */
+#define MATCH_LIMIT 12
+/* Largest distance back to a match. */
+#define MAX_OFFSET 65535
+
+/* Returns the 4 bytes at P, which need not be aligned. */
+static uint32_t
+read32 (const uint8_t *p) 
+{
+  uint32_t value;
+  memcpy (&value, p, sizeof value);
+  return value;
+}
+
+/* Returns the hash table index for the 4 bytes SEQUENCE. */
+static unsigned
+hash_sequence (uint32_t sequence) 
+{
+  return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+/* Writes LENGTH - 15, the part of a length that doesn't fit into
+   the token, to *OP as a run of 255 bytes and a final byte.
+   Returns false if it doesn't fit before END. */
+static bool
+write_length (uint8_t **op, const uint8_t *end, size_t length) 
+{
+  for (length -= 15; length >= 255; length -= 255) 
+    {
+      if (*op >= end)
+        return false;
+      *(*op)++ = 255;
+    }
+  if (*op >= end)
+    return false;
+  *(*op)++ = length;
+  return true;
+}
+
+/* Writes a sequence of the LITERAL_CNT bytes at LITERALS followed
+   by a match of MATCH_LENGTH bytes OFFSET bytes back to *OP, or
+   only the literals if MATCH_LENGTH is 0.  Returns false if the
+   sequence doesn't fit before END. */
+static bool
+write_sequence (uint8_t **op, const uint8_t *end, const uint8_t *literals,
+                size_t literal_cnt, size_t offset, size_t match_length) 
+{
+  uint8_t *token = *op;
+  size_t match_code = match_length > 0 ? match_length - MIN_MATCH : 0;
+
+  if (*op >= end)
+    return false;
+  (*op)++;
+  *token = (literal_cnt < 15 ? literal_cnt : 15) << 4;
+  if (literal_cnt >= 15 && !write_length (op, end, literal_cnt))
+    return false;
+  if ((size_t) (end - *op) < literal_cnt)
+    return false;
+  memcpy (*op, literals, literal_cnt);
+  *op += literal_cnt;
+  if (match_length == 0)
+    return true;
+
+  if (end - *op < 2)
+    return false;
+  *(*op)++ = offset & 0xff;
+  *(*op)++ = offset >> 8;
+  *token |= match_code < 15 ? match_code : 15;
+  return match_code < 15 || write_length (op, end, match_code);
+}
+
+/* Compresses the SRC_SIZE bytes at SRC into DST, using the
+   LZ4_WORK_SIZE bytes at WORK as scratch memory.  Returns the
+   compressed size, or 0 if it would be larger than DST_SIZE. */
+size_t
+lz4_compress (const void *src_, size_t src_size,
+              void *dst_, size_t dst_size, void *work) 
+{
+  const uint8_t *src = src_;
+  uint8_t *op = dst_;
+  const uint8_t *end = op + dst_size;
+  uint16_t *table = work;
+  size_t ip = 0;
+  size_t anchor = 0;
+
+  ASSERT (src_size <= LZ4_MAX_INPUT);
+
+  /* Table entries are 1 past the last position with that hash,
+     so 0 means none. */
+  memset (table, 0, LZ4_WORK_SIZE);
+  while (src_size >= MATCH_LIMIT + 1 && ip < src_size - MATCH_LIMIT) 
+    {
+      uint32_t sequence = read32 (src + ip);
+      unsigned hash = hash_sequence (sequence);
+      size_t ref = table[hash];
+      table[hash] = ip + 1;
+      if (ref == 0 || ip - (ref - 1) > MAX_OFFSET
+          || read32 (src + ref - 1) != sequence) 
+        {
+          ip++;
+          continue;
+        }
+      ref--;
+
+      size_t length = MIN_MATCH;
+      while (ip + length < src_size - LAST_LITERALS
+             && src[ref + length] == src[ip + length])
+        length++;
+      if (!write_sequence (&op, end, src + anchor, ip - anchor, ip - ref,
+                           length))
+        return 0;
+      ip += length;
+      anchor = ip;
+    }
+
+  if (!write_sequence (&op, end, src + anchor, src_size - anchor, 0, 0))
+    return 0;
+  return op - (uint8_t *) dst_;
+}
+
+/* Reads a length extension at *IP before END into *LENGTH.
+   Returns false if the input ends first. */
+static bool
+read_length (const uint8_t **ip, const uint8_t *end, size_t *length) 
+{
+  uint8_t byte;
+  do 
+    {
+      if (*ip >= end)
+        return false;
+      byte = *(*ip)++;
+      *length += byte;
+    }
+  while (byte == 255);
+  return true;
+}
+
+/* Decompresses the SRC_SIZE bytes of LZ4 data at SRC into DST.
+   Returns the decompressed size, or 0 if the data is corrupt or
+   would be larger than DST_SIZE. */
+size_t
+lz4_decompress (const void *src, size_t src_size,
+                void *dst_, size_t dst_size) 
+{
+  const uint8_t *ip = src;
+  const uint8_t *end = ip + src_size;
+  uint8_t *dst = dst_;
+  size_t op = 0;
+
+  while (ip < end) 
+    {
+      uint8_t token = *ip++;
+      size_t literal_cnt = token >> 4;
+      if (literal_cnt == 15 && !read_length (&ip, end, &literal_cnt))
+        return 0;
+      if ((size_t) (end - ip) < literal_cnt || dst_size - op < literal_cnt)
+        return 0;
+      memcpy (dst + op, ip, literal_cnt);
+      ip += literal_cnt;
+      op += literal_cnt;
+
+      /* The last sequence has no match. */
+      if (ip == end)
+        break;
+
+      if (end - ip < 2)
+        return 0;
+      size_t offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > op)
+        return 0;
+
+      size_t length = token & 15;
+      if (length == 15 && !read_length (&ip, end, &length))
+        return 0;
+      length += MIN_MATCH;
+      if (dst_size - op < length)
+        return 0;
+      /* The match may overlap the bytes being written. */
+      for (size_t i = 0; i < length; i++, op++)
+        dst[op] = dst[op - offset];
+    }
+  return op;
+}
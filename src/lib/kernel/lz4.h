@@ -0,0 +1,23 @@
+#ifndef __LIB_KERNEL_LZ4_H
+#define __LIB_KERNEL_LZ4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* LZ4 block compression.
+
+   Compresses buffers of at most LZ4_MAX_INPUT bytes into the LZ4
+   block format, without the frame header.  The compressor needs
+   LZ4_WORK_SIZE bytes of scratch memory from the caller, since
+   it is too large for a kernel stack. */
+
+#define LZ4_HASH_BITS 10
+#define LZ4_WORK_SIZE ((1 << LZ4_HASH_BITS) * sizeof (uint16_t))
+#define LZ4_MAX_INPUT 65535
+
+size_t lz4_compress (const void *src, size_t src_size,
+                     void *dst, size_t dst_size, void *work);
+size_t lz4_decompress (const void *src, size_t src_size,
+                       void *dst, size_t dst_size);
+
+#endif /* lib/kernel/lz4.h */
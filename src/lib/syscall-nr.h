@@ -28,7 +28,16 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_CLONE_FILE,             /* Copy a file, sharing its blocks. */
+    SYS_SET_COMPRESSED,         /* Turn compression of a file on or off. */
+    SYS_FORK,                   /* Duplicate the current process. */
+    SYS_MSYNC,                  /* Write a memory mapping back to its file. */
+    SYS_MMAP_RANGE,             /* Map part of a file into memory. */
+    SYS_MADVISE,                /* Advise on the use of memory. */
+    SYS_VMSTAT                  /* Get paging statistics of the process. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -12,6 +12,31 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Flags for mmap_range(). */
+#define MAP_SHARED   0          /* Writes go to the file, seen by all. */
+#define MAP_PRIVATE  1          /* Writes are private to the process. */
+#define MAP_READONLY 2          /* Writes to the mapping fault. */
+#define MAP_POPULATE 4          /* Load the whole mapping up front. */
+
+/* Advice for madvise(). */
+#define MADV_NORMAL     0       /* No particular access pattern. */
+#define MADV_RANDOM     1       /* Random accesses, don't read ahead. */
+#define MADV_SEQUENTIAL 2       /* Sequential accesses, read ahead. */
+#define MADV_WILLNEED   3       /* Load the pages now. */
+#define MADV_DONTNEED   4       /* Drop the pages' data now. */
+
+/* Memory and paging statistics of a process, read by vmstat(). */
+struct vmstat
+  {
+    unsigned minor_faults;      /* Faults served from memory. */
+    unsigned major_faults;      /* Faults that read a disk. */
+    unsigned swap_ins;          /* Pages read back from swap. */
+    unsigned swap_outs;         /* Pages written to swap. */
+    unsigned mmap_writebacks;   /* Mapped file pages written back. */
+    unsigned resident_pages;    /* Pages now in memory. */
+    unsigned swapped_pages;     /* Pages now in swap. */
+  };
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -45,4 +70,14 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool clone_file (const char *source, const char *target);
+bool set_compressed (int fd, bool compressed);
+pid_t fork (void);
+bool msync (mapid_t);
+mapid_t mmap_range (int fd, void *addr, unsigned offset, unsigned length,
+                    int flags);
+bool madvise (void *addr, unsigned length, int advice);
+bool vmstat (struct vmstat *);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"orig" => ["a" x 4096 . "b" x 100 . "a" x 1804],
+                "copy" => ["c" x 100 . "a" x 5900]});
+pass;
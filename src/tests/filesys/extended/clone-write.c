@@ -0,0 +1,46 @@
+/* Clones a file, then writes to both the original and the clone.
+   The files share their blocks until they are written, so each
+   write must only show up in the file it was made to. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 6000
+
+static char orig[FILE_SIZE];
+static char copy[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  memset (orig, 'a', sizeof orig);
+  CHECK (create ("orig", sizeof orig), "create \"orig\"");
+  CHECK ((fd = open ("orig")) > 1, "open \"orig\"");
+  CHECK (write (fd, orig, sizeof orig) == (int) sizeof orig,
+         "write \"orig\"");
+  msg ("close \"orig\"");
+  close (fd);
+
+  CHECK (clone_file ("orig", "copy"), "clone \"orig\" to \"copy\"");
+  memcpy (copy, orig, sizeof copy);
+
+  memset (orig + 4096, 'b', 100);
+  CHECK ((fd = open ("orig")) > 1, "open \"orig\"");
+  seek (fd, 4096);
+  CHECK (write (fd, orig + 4096, 100) == 100, "write \"orig\" at 4096");
+  msg ("close \"orig\"");
+  close (fd);
+
+  memset (copy, 'c', 100);
+  CHECK ((fd = open ("copy")) > 1, "open \"copy\"");
+  CHECK (write (fd, copy, 100) == 100, "write \"copy\" at 0");
+  msg ("close \"copy\"");
+  close (fd);
+
+  check_file ("orig", orig, sizeof orig);
+  check_file ("copy", copy, sizeof copy);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(clone-write) begin
+(clone-write) create "orig"
+(clone-write) open "orig"
+(clone-write) write "orig"
+(clone-write) close "orig"
+(clone-write) clone "orig" to "copy"
+(clone-write) open "orig"
+(clone-write) write "orig" at 4096
+(clone-write) close "orig"
+(clone-write) open "copy"
+(clone-write) write "copy" at 0
+(clone-write) close "copy"
+(clone-write) open "orig" for verification
+(clone-write) verified contents of "orig"
+(clone-write) close "orig"
+(clone-write) open "copy" for verification
+(clone-write) verified contents of "copy"
+(clone-write) close "copy"
+(clone-write) end
+EOF
+pass;
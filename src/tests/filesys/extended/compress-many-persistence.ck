@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my (%files);
+$files{"file$_"} = [chr (ord ('a') + $_) x (2 * 4096 + 100)] foreach 0 .. 9;
+check_archive (\%files);
+pass;
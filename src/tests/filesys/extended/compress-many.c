@@ -0,0 +1,69 @@
+/* Keeps many compressed files open at once and reads them in turns.
+   Each open compressed file being read holds a decompressed cluster
+   in a kernel allocation spanning several pages, so this allocates
+   and frees many multi-page blocks, in varying orders. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 10
+#define FILE_SIZE (2 * 4096 + 100)
+#define CHUNK_SIZE 512
+#define ROUNDS 4
+
+static char buf[FILE_SIZE];
+static char check[CHUNK_SIZE];
+
+void
+test_main (void) 
+{
+  char name[16];
+  int fds[FILE_CNT];
+  int round, i;
+
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "file%d", i);
+      memset (buf, 'a' + i, sizeof buf);
+      if (!create (name, 0) || (fd = open (name)) < 2)
+        fail ("create \"%s\" failed", name);
+      if (!set_compressed (fd, true))
+        fail ("compress \"%s\" failed", name);
+      if (write (fd, buf, sizeof buf) != (int) sizeof buf)
+        fail ("write \"%s\" failed", name);
+      close (fd);
+    }
+  msg ("create %d compressed files", FILE_CNT);
+
+  for (round = 0; round < ROUNDS; round++) 
+    {
+      size_t ofs;
+
+      for (i = 0; i < FILE_CNT; i++) 
+        {
+          snprintf (name, sizeof name, "file%d", i);
+          if ((fds[i] = open (name)) < 2)
+            fail ("open \"%s\" failed", name);
+        }
+      for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+        for (i = 0; i < FILE_CNT; i++) 
+          {
+            size_t size = CHUNK_SIZE;
+            if (size > FILE_SIZE - ofs)
+              size = FILE_SIZE - ofs;
+            memset (buf, 'a' + i, size);
+            if (read (fds[i], check, size) != (int) size
+                || memcmp (check, buf, size))
+              fail ("file%d differs at %zu", i, ofs);
+          }
+      /* Free the allocations in a different order each round. */
+      for (i = 0; i < FILE_CNT; i++)
+        close (fds[(i * 3 + round) % FILE_CNT]);
+    }
+  msg ("read all files at once %d times", ROUNDS);
+}
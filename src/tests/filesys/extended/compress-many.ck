@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(compress-many) begin
+(compress-many) create 10 compressed files
+(compress-many) read all files at once 4 times
+(compress-many) end
+EOF
+pass;
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($packed) = random_bytes (3 * 4096 + 100);
+substr ($packed, 0, 4096) = "z" x 4096;
+substr ($packed, 2 * 4096, 4096) = "\0" x 4096;
+substr ($packed, 4096 - 100, 200) = "y" x 200;
+check_archive ({"packed" => [$packed]});
+pass;
@@ -0,0 +1,37 @@
+/* Writes a compressed file with a compressible cluster, a cluster
+   of random data, a cluster of zeros and a partial cluster, then
+   overwrites a range crossing two clusters and reads it all back. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CLUSTER_SIZE 4096
+
+static char buf[3 * CLUSTER_SIZE + 100];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  memset (buf, 'z', CLUSTER_SIZE);
+  memset (buf + 2 * CLUSTER_SIZE, 0, CLUSTER_SIZE);
+
+  CHECK (create ("packed", 0), "create \"packed\"");
+  CHECK ((fd = open ("packed")) > 1, "open \"packed\"");
+  CHECK (set_compressed (fd, true), "compress \"packed\"");
+  CHECK (write (fd, buf, sizeof buf) == (int) sizeof buf, "write \"packed\"");
+
+  memset (buf + CLUSTER_SIZE - 100, 'y', 200);
+  seek (fd, CLUSTER_SIZE - 100);
+  CHECK (write (fd, buf + CLUSTER_SIZE - 100, 200) == 200,
+         "overwrite \"packed\" across clusters");
+  msg ("close \"packed\"");
+  close (fd);
+
+  check_file ("packed", buf, sizeof buf);
+}
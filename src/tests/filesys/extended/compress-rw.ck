@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(compress-rw) begin
+(compress-rw) create "packed"
+(compress-rw) open "packed"
+(compress-rw) compress "packed"
+(compress-rw) write "packed"
+(compress-rw) overwrite "packed" across clusters
+(compress-rw) close "packed"
+(compress-rw) open "packed" for verification
+(compress-rw) verified contents of "packed"
+(compress-rw) close "packed"
+(compress-rw) end
+EOF
+pass;
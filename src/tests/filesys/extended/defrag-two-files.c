@@ -0,0 +1,81 @@
+/* Grows two files alternately a sector at a time, so their blocks
+   are interleaved, with the defragmenter running.  Reads both files
+   back several times while the defragmenter relocates them, then
+   appends to one of them and checks both. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 20000
+#define CHUNK_SIZE 512
+#define APPEND_SIZE 1000
+
+static char buf_a[FILE_SIZE + APPEND_SIZE];
+static char buf_b[FILE_SIZE];
+static char check[FILE_SIZE + APPEND_SIZE];
+
+/* Checks that the file NAME holds the SIZE bytes in BUF. */
+static void
+verify (const char *name, const char *buf, size_t size) 
+{
+  int fd = open (name);
+  if (fd < 2)
+    fail ("open \"%s\" failed", name);
+  if (read (fd, check, size) != (int) size || memcmp (check, buf, size))
+    fail ("\"%s\" differs", name);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  int fd_a, fd_b;
+  size_t ofs;
+  int i;
+
+  random_bytes (buf_a, FILE_SIZE);
+  random_bytes (buf_b, FILE_SIZE);
+  memset (buf_a + FILE_SIZE, 'x', APPEND_SIZE);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK ((fd_a = open ("a")) > 1, "open \"a\"");
+  CHECK ((fd_b = open ("b")) > 1, "open \"b\"");
+
+  msg ("write \"a\" and \"b\" alternately");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE) 
+    {
+      size_t size = CHUNK_SIZE;
+      if (size > FILE_SIZE - ofs)
+        size = FILE_SIZE - ofs;
+      if (write (fd_a, buf_a + ofs, size) != (int) size)
+        fail ("write \"a\" at %zu failed", ofs);
+      if (write (fd_b, buf_b + ofs, size) != (int) size)
+        fail ("write \"b\" at %zu failed", ofs);
+    }
+
+  msg ("close \"a\"");
+  close (fd_a);
+  msg ("close \"b\"");
+  close (fd_b);
+
+  msg ("read \"a\" and \"b\" while they are defragmented");
+  for (i = 0; i < 50; i++) 
+    {
+      verify ("a", buf_a, FILE_SIZE);
+      verify ("b", buf_b, FILE_SIZE);
+    }
+
+  CHECK ((fd_a = open ("a")) > 1, "open \"a\"");
+  seek (fd_a, FILE_SIZE);
+  CHECK (write (fd_a, buf_a + FILE_SIZE, APPEND_SIZE) == APPEND_SIZE,
+         "append to \"a\"");
+  msg ("close \"a\"");
+  close (fd_a);
+
+  check_file ("a", buf_a, sizeof buf_a);
+  check_file ("b", buf_b, sizeof buf_b);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(defrag-two-files) begin
+(defrag-two-files) create "a"
+(defrag-two-files) create "b"
+(defrag-two-files) open "a"
+(defrag-two-files) open "b"
+(defrag-two-files) write "a" and "b" alternately
+(defrag-two-files) close "a"
+(defrag-two-files) close "b"
+(defrag-two-files) read "a" and "b" while they are defragmented
+(defrag-two-files) open "a"
+(defrag-two-files) append to "a"
+(defrag-two-files) close "a"
+(defrag-two-files) open "a" for verification
+(defrag-two-files) verified contents of "a"
+(defrag-two-files) close "a"
+(defrag-two-files) open "b" for verification
+(defrag-two-files) verified contents of "b"
+(defrag-two-files) close "b"
+(defrag-two-files) end
+EOF
+pass;
@@ -0,0 +1,85 @@
+/* Fills a file that was removed while open, reads it back and closes
+   it, several times over.  Together the files are larger than the
+   disk, so the blocks of each removed file must be reclaimed once it
+   is closed.  Reclaiming happens in the background, so a write that
+   runs out of space is retried for a while. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (512 * 1024)
+#define CHUNK_SIZE 4096
+#define ROUNDS 6
+
+static char chunk[CHUNK_SIZE];
+static char check[CHUNK_SIZE];
+
+/* Spins for a while, so other threads get to run. */
+static void
+spin (void) 
+{
+  volatile int i;
+
+  for (i = 0; i < 100000; i++)
+    continue;
+}
+
+/* Writes CHUNK to FD until FILE_SIZE bytes are written, retrying
+   while the disk is full. */
+static void
+fill (int fd, int round) 
+{
+  size_t ofs = 0;
+  int tries = 0;
+
+  while (ofs < FILE_SIZE) 
+    {
+      size_t size = CHUNK_SIZE - ofs % CHUNK_SIZE;
+      int written = write (fd, chunk + ofs % CHUNK_SIZE, size);
+      if (written > 0)
+        ofs += written;
+      else if (++tries < 1000)
+        spin ();
+      else
+        fail ("round %d: disk still full after writing %zu bytes",
+              round, ofs);
+    }
+}
+
+void
+test_main (void) 
+{
+  int round;
+
+  msg ("fill, check and close a removed file %d times", ROUNDS);
+  for (round = 0; round < ROUNDS; round++) 
+    {
+      size_t ofs;
+      int fd;
+
+      if (!create ("orphan", 0))
+        fail ("round %d: create \"orphan\" failed", round);
+      if ((fd = open ("orphan")) < 2)
+        fail ("round %d: open \"orphan\" failed", round);
+      if (!remove ("orphan"))
+        fail ("round %d: remove \"orphan\" failed", round);
+      if (open ("orphan") != -1)
+        fail ("round %d: removed \"orphan\" could be opened", round);
+
+      memset (chunk, 'a' + round, sizeof chunk);
+      fill (fd, round);
+
+      seek (fd, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE) 
+        {
+          if (read (fd, check, CHUNK_SIZE) != CHUNK_SIZE)
+            fail ("round %d: read at %zu failed", round, ofs);
+          if (memcmp (check, chunk, CHUNK_SIZE))
+            fail ("round %d: data at %zu differs", round, ofs);
+        }
+      close (fd);
+    }
+  msg ("done");
+}
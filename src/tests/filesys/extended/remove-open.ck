@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(remove-open) begin
+(remove-open) fill, check and close a removed file 6 times
+(remove-open) done
+(remove-open) end
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Forks after filling a buffer, then writes to part of the buffer
+   in the child.  Parent and child share the buffer's pages until
+   one of them writes, so only the child may see the write. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_EXIT 81
+
+static char buf[3 * 4096];
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  memset (buf, 'p', sizeof buf);
+  child = fork ();
+  if (child == 0)
+    {
+      memset (buf + 4096, 'c', 4096);
+      if (buf[0] != 'p' || buf[4096] != 'c' || buf[2 * 4096] != 'p')
+        fail ("child sees wrong data after its write");
+      exit (CHILD_EXIT);
+    }
+  CHECK (child != PID_ERROR, "fork");
+  CHECK (wait (child) == CHILD_EXIT, "wait for child");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 'p')
+      fail ("parent sees child's write at offset %zu", i);
+  msg ("parent's buffer unchanged");
+}
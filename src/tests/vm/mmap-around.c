@@ -0,0 +1,52 @@
+/* Maps a 16 page file and reads every page of the mapping.  Faults
+   map the neighbouring pages of the file as well, so fewer faults
+   than pages must be taken. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 16
+#define ACTUAL ((char *) 0x10000000)
+
+static char page_buf[PAGE_SIZE];
+
+void
+test_main (void)
+{
+  struct vmstat before, after;
+  unsigned faults;
+  int handle;
+  mapid_t map;
+  size_t page, i;
+
+  CHECK (create ("pages", 0), "create \"pages\"");
+  CHECK ((handle = open ("pages")) > 1, "open \"pages\"");
+  for (page = 0; page < PAGE_CNT; page++) 
+    {
+      memset (page_buf, 'a' + page, PAGE_SIZE);
+      if (write (handle, page_buf, PAGE_SIZE) != PAGE_SIZE)
+        fail ("write page %zu failed", page);
+    }
+  msg ("wrote %d pages", PAGE_CNT);
+
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"pages\"");
+  CHECK (vmstat (&before), "vmstat");
+  for (page = 0; page < PAGE_CNT; page++)
+    for (i = 0; i < PAGE_SIZE; i++)
+      if (ACTUAL[page * PAGE_SIZE + i] != (char) ('a' + page))
+        fail ("byte %zu of page %zu != '%c'", i, page, 'a' + (int) page);
+  CHECK (vmstat (&after), "vmstat");
+  msg ("read mapped pages");
+
+  faults = (after.minor_faults - before.minor_faults
+            + after.major_faults - before.major_faults);
+  if (faults >= PAGE_CNT / 2)
+    fail ("%u faults for reading %d pages", faults, PAGE_CNT);
+  msg ("faults mapped neighbouring pages");
+
+  munmap (map);
+  close (handle);
+}
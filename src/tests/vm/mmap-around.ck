@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-around) begin
+(mmap-around) create "pages"
+(mmap-around) open "pages"
+(mmap-around) wrote 16 pages
+(mmap-around) mmap "pages"
+(mmap-around) vmstat
+(mmap-around) vmstat
+(mmap-around) read mapped pages
+(mmap-around) faults mapped neighbouring pages
+(mmap-around) end
+EOF
+pass;
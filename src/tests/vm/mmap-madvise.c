@@ -0,0 +1,52 @@
+/* Gives each kind of advice for a shared file mapping and for
+   anonymous memory.  Advice never changes the data, except that
+   dropping anonymous memory turns it back into zeros, while
+   dropped file pages keep what was written to them. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+static char zeros[2 * 4096] __attribute__ ((aligned (4096)));
+
+void
+test_main (void)
+{
+  char *actual = ACTUAL;
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, actual)) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (madvise (actual, strlen (sample), MADV_SEQUENTIAL),
+         "madvise sequential");
+  CHECK (madvise (actual, strlen (sample), MADV_WILLNEED), "madvise willneed");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mapped file returned wrong data");
+  msg ("compare mapped data");
+
+  actual[0] = sample[0] = 'X';
+  CHECK (madvise (actual, strlen (sample), MADV_DONTNEED),
+         "madvise dontneed on mapped file");
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("dropped file page lost its data");
+  msg ("compare mapped data after dropping it");
+  munmap (map);
+  close (handle);
+  check_file ("sample.txt", sample, strlen (sample));
+
+  memset (zeros, 'a', sizeof zeros);
+  CHECK (madvise (zeros, sizeof zeros, MADV_DONTNEED),
+         "madvise dontneed on anonymous memory");
+  for (i = 0; i < sizeof zeros; i++)
+    if (zeros[i] != 0)
+      fail ("dropped anonymous memory not zero at offset %zu", i);
+  msg ("dropped anonymous memory is zero");
+
+  CHECK (!madvise (actual, 4096, 99), "madvise with bad advice fails");
+}
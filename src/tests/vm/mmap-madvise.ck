@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-madvise) begin
+(mmap-madvise) open "sample.txt"
+(mmap-madvise) mmap "sample.txt"
+(mmap-madvise) madvise sequential
+(mmap-madvise) madvise willneed
+(mmap-madvise) compare mapped data
+(mmap-madvise) madvise dontneed on mapped file
+(mmap-madvise) compare mapped data after dropping it
+(mmap-madvise) open "sample.txt" for verification
+(mmap-madvise) verified contents of "sample.txt"
+(mmap-madvise) close "sample.txt"
+(mmap-madvise) madvise dontneed on anonymous memory
+(mmap-madvise) dropped anonymous memory is zero
+(mmap-madvise) madvise with bad advice fails
+(mmap-madvise) end
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Maps a file privately and writes to the mapping.  The writes
+   must be visible through the mapping, but never reach the file,
+   neither while it is mapped nor after it is unmapped. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  char *actual = ACTUAL;
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap_range (handle, actual, 0, 0, MAP_PRIVATE)) != MAP_FAILED,
+         "mmap \"sample.txt\" privately");
+  memset (actual, 'X', strlen (sample));
+  for (i = 0; i < strlen (sample); i++)
+    if (actual[i] != 'X')
+      fail ("private write lost at offset %zu", i);
+  msg ("private writes visible in mapping");
+
+  check_file ("sample.txt", sample, strlen (sample));
+  munmap (map);
+  check_file ("sample.txt", sample, strlen (sample));
+  close (handle);
+}
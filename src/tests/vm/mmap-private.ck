@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-private) begin
+(mmap-private) open "sample.txt"
+(mmap-private) mmap "sample.txt" privately
+(mmap-private) private writes visible in mapping
+(mmap-private) open "sample.txt" for verification
+(mmap-private) verified contents of "sample.txt"
+(mmap-private) close "sample.txt"
+(mmap-private) open "sample.txt" for verification
+(mmap-private) verified contents of "sample.txt"
+(mmap-private) close "sample.txt"
+(mmap-private) end
+EOF
+pass;
@@ -0,0 +1,51 @@
+/* Reads a file with read() straight into memory that was never
+   touched, and into a memory mapping of another file.  Both buffers
+   must be faulted in and pinned by the kernel before the read, and
+   the data read into the mapping must reach its file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SIZE (3 * PAGE_SIZE)
+#define ACTUAL ((char *) 0x10000000)
+
+static char data[SIZE];
+static char untouched[SIZE + PAGE_SIZE];
+
+void
+test_main (void)
+{
+  int src, dst;
+  mapid_t map;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    data[i] = 'a' + i % 26;
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK ((src = open ("src")) > 1, "open \"src\"");
+  CHECK (write (src, data, SIZE) == SIZE, "write \"src\"");
+
+  /* Straddles pages, starting partway into the first one. */
+  seek (src, 0);
+  CHECK (read (src, untouched + 100, SIZE) == SIZE,
+         "read \"src\" into untouched memory");
+  if (memcmp (untouched + 100, data, SIZE))
+    fail ("untouched memory doesn't hold \"src\"");
+
+  CHECK (create ("dst", SIZE), "create \"dst\"");
+  CHECK ((dst = open ("dst")) > 1, "open \"dst\"");
+  CHECK ((map = mmap (dst, ACTUAL)) != MAP_FAILED, "mmap \"dst\"");
+  seek (src, 0);
+  CHECK (read (src, ACTUAL, SIZE) == SIZE,
+         "read \"src\" into \"dst\" mapping");
+  if (memcmp (ACTUAL, data, SIZE))
+    fail ("mapping doesn't hold \"src\"");
+  munmap (map);
+  close (dst);
+  close (src);
+
+  check_file ("dst", data, SIZE);
+}
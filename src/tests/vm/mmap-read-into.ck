@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-read-into) begin
+(mmap-read-into) create "src"
+(mmap-read-into) open "src"
+(mmap-read-into) write "src"
+(mmap-read-into) read "src" into untouched memory
+(mmap-read-into) create "dst"
+(mmap-read-into) open "dst"
+(mmap-read-into) mmap "dst"
+(mmap-read-into) read "src" into "dst" mapping
+(mmap-read-into) open "dst" for verification
+(mmap-read-into) verified contents of "dst"
+(mmap-read-into) close "dst"
+(mmap-read-into) end
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* Run with 8 MB of RAM and without the compressed swap cache.
+   Writes 6 MB of memory, more than the user pool holds, then reads
+   it back in order.  Pages are written to swap in clusters of
+   neighbouring pages, and a fault on one of them reads the rest of
+   its cluster ahead, so fewer faults than swap ins must be taken. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SIZE (6 * 1024 * 1024)
+#define PAGE_CNT (SIZE / PAGE_SIZE)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  struct vmstat before, after;
+  size_t page, i;
+
+  msg ("initialize");
+  for (page = 0; page < PAGE_CNT; page++)
+    memset (buf + page * PAGE_SIZE, page * 13 + 5, PAGE_SIZE);
+
+  CHECK (vmstat (&before), "vmstat");
+  msg ("read pass");
+  for (page = 0; page < PAGE_CNT; page++)
+    for (i = 0; i < PAGE_SIZE; i++)
+      if (buf[page * PAGE_SIZE + i] != (char) (page * 13 + 5))
+        fail ("byte %zu != %d", page * PAGE_SIZE + i,
+              (char) (page * 13 + 5));
+  CHECK (vmstat (&after), "vmstat");
+
+  if (after.swap_ins == before.swap_ins)
+    fail ("no pages were swapped in");
+  if (after.major_faults - before.major_faults
+      >= after.swap_ins - before.swap_ins)
+    fail ("%u faults for %u swap ins, no pages were read ahead",
+          after.major_faults - before.major_faults,
+          after.swap_ins - before.swap_ins);
+  msg ("pages were read ahead");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-cluster) begin
+(page-cluster) initialize
+(page-cluster) vmstat
+(page-cluster) read pass
+(page-cluster) vmstat
+(page-cluster) pages were read ahead
+(page-cluster) end
+EOF
+pass;
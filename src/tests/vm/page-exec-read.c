@@ -0,0 +1,51 @@
+/* Reads the code and read-only data of the running executable with
+   read(), and checks that they match the pages the process runs
+   from.  Both share the same page cache frames, so each page is
+   read once before and once after it is faulted in. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+/* The code segment is mapped here from offset 0 of the file. */
+#define CODE_START ((const char *) 0x08048000)
+
+/* Placed after the code, with the other read-only data. */
+static const char marker[] = "end of read-only data";
+
+static char buf[PAGE_SIZE];
+
+/* Reads SIZE bytes at the offset of PAGE in the executable open as
+   FD, and compares them to PAGE. */
+static void
+compare_page (int fd, const char *page, size_t size) 
+{
+  seek (fd, page - CODE_START);
+  if (read (fd, buf, size) != (int) size)
+    fail ("read of page at %p failed", page);
+  if (memcmp (buf, page, size))
+    fail ("page at %p differs from the executable", page);
+}
+
+void
+test_main (void)
+{
+  const char *end = marker + sizeof marker;
+  const char *page;
+  int fd;
+
+  CHECK ((fd = open (test_name)) > 1, "open \"%s\"", test_name);
+  msg ("compare code pages");
+  for (page = CODE_START; page < end; page += PAGE_SIZE) 
+    {
+      size_t size = end - page < PAGE_SIZE ? end - page : PAGE_SIZE;
+      compare_page (fd, page, size);
+      compare_page (fd, page, size);
+    }
+  msg ("close \"%s\"", test_name);
+  close (fd);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-exec-read) begin
+(page-exec-read) open "page-exec-read"
+(page-exec-read) compare code pages
+(page-exec-read) close "page-exec-read"
+(page-exec-read) end
+EOF
+pass;
@@ -0,0 +1,46 @@
+/* Run with 8 MB of RAM, where the kernel maps physical memory
+   with large pages.  Writes 6 MB of memory, more than the user
+   pool holds, so that pages must be evicted and read back, and
+   verifies them twice. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SIZE (6 * 1024 * 1024)
+#define PAGE_CNT (SIZE / PAGE_SIZE)
+
+static char buf[SIZE];
+
+/* Checks that every byte of page PAGE of BUF is VALUE. */
+static void
+check_page (size_t page, char value)
+{
+  size_t i;
+
+  for (i = 0; i < PAGE_SIZE; i++)
+    if (buf[page * PAGE_SIZE + i] != value)
+      fail ("byte %zu != %d", page * PAGE_SIZE + i, value);
+}
+
+void
+test_main (void)
+{
+  size_t page;
+
+  msg ("initialize");
+  for (page = 0; page < PAGE_CNT; page++)
+    memset (buf + page * PAGE_SIZE, page * 7 + 1, PAGE_SIZE);
+
+  msg ("read/modify/write pass");
+  for (page = PAGE_CNT; page-- > 0; )
+    {
+      check_page (page, page * 7 + 1);
+      memset (buf + page * PAGE_SIZE, page * 11 + 3, PAGE_SIZE);
+    }
+
+  msg ("read pass");
+  for (page = 0; page < PAGE_CNT; page++)
+    check_page (page, page * 11 + 3);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-large) begin
+(page-large) initialize
+(page-large) read/modify/write pass
+(page-large) read pass
+(page-large) end
+EOF
+pass;
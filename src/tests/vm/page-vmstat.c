@@ -0,0 +1,41 @@
+/* Writes 2 MB of memory, so that part of it must be swapped
+   out, reads it back, and checks that the counters returned by
+   vmstat() account for the swapping. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  struct vmstat st;
+  size_t i;
+
+  msg ("initialize");
+  memset (buf, 0x5a, sizeof buf);
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0x5a)
+      fail ("byte %zu != 0x5a", i);
+
+  CHECK (vmstat (&st), "vmstat");
+  if (st.swap_outs == 0)
+    fail ("no pages were swapped out");
+  if (st.swap_ins == 0)
+    fail ("no pages were swapped in");
+  if (st.major_faults == 0)
+    fail ("no major faults were counted");
+  if (st.resident_pages == 0)
+    fail ("no pages are resident");
+  if (st.resident_pages + st.swapped_pages < SIZE / 4096)
+    fail ("%u resident and %u swapped pages don't cover the buffer",
+          st.resident_pages, st.swapped_pages);
+  msg ("counters account for swapping");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-vmstat) begin
+(page-vmstat) initialize
+(page-vmstat) read pass
+(page-vmstat) vmstat
+(page-vmstat) counters account for swapping
+(page-vmstat) end
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* Reads 1 MB of untouched memory, which must read as zeros without
+   a frame being allocated for each page, since reads map the shared
+   zero page.  Then writes a byte to every 16th page and checks that
+   only those pages changed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SIZE (1024 * 1024)
+#define PAGE_CNT (SIZE / PAGE_SIZE)
+
+static char buf[SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+void
+test_main (void)
+{
+  struct vmstat before, after;
+  size_t i;
+
+  CHECK (vmstat (&before), "vmstat");
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu != 0", i);
+  CHECK (vmstat (&after), "vmstat");
+  if (after.resident_pages - before.resident_pages >= PAGE_CNT / 2)
+    fail ("%u pages became resident for reading %d zero pages",
+          after.resident_pages - before.resident_pages, PAGE_CNT);
+
+  msg ("write every 16th page");
+  for (i = 0; i < PAGE_CNT; i += 16)
+    buf[i * PAGE_SIZE + i] = 'x';
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++) 
+    {
+      size_t page = i / PAGE_SIZE;
+      char expected = page % 16 == 0 && i % PAGE_SIZE == page ? 'x' : 0;
+      if (buf[i] != expected)
+        fail ("byte %zu != %d", i, expected);
+    }
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-zero-read) begin
+(page-zero-read) vmstat
+(page-zero-read) read pass
+(page-zero-read) vmstat
+(page-zero-read) write every 16th page
+(page-zero-read) read pass
+(page-zero-read) end
+EOF
+pass;
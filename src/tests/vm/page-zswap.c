@@ -0,0 +1,72 @@
+/* Run with 8 MB of RAM and a 1 MB compressed swap cache.  Writes
+   6 MB of memory, more than the user pool holds, alternating pages
+   that compress well with pages of pseudo-random bytes that don't,
+   so evicted pages go both to the swap cache and to the disk.
+   Checks all pages twice, rewriting them in between. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SIZE (6 * 1024 * 1024)
+#define PAGE_CNT (SIZE / PAGE_SIZE)
+
+static char buf[SIZE];
+
+/* Fills page PAGE of BUF for pass PASS, or checks that it was. */
+static void
+page_data (size_t page, int pass, bool check) 
+{
+  char *data = buf + page * PAGE_SIZE;
+  uint32_t x = page * 2654435761u + pass + 1;
+  size_t i;
+
+  for (i = 0; i < PAGE_SIZE; i++) 
+    {
+      char value;
+      if (page % 2 == 0)
+        value = "compressible"[(i + page + pass) % 12];
+      else 
+        {
+          x ^= x << 13;
+          x ^= x >> 17;
+          x ^= x << 5;
+          value = x;
+        }
+      if (!check)
+        data[i] = value;
+      else if (data[i] != value)
+        fail ("byte %zu != %d in pass %d", page * PAGE_SIZE + i, value,
+              pass);
+    }
+}
+
+void
+test_main (void)
+{
+  struct vmstat st;
+  size_t page;
+
+  msg ("initialize");
+  for (page = 0; page < PAGE_CNT; page++)
+    page_data (page, 0, false);
+
+  msg ("read/modify/write pass");
+  for (page = PAGE_CNT; page-- > 0; ) 
+    {
+      page_data (page, 0, true);
+      page_data (page, 1, false);
+    }
+
+  msg ("read pass");
+  for (page = 0; page < PAGE_CNT; page++)
+    page_data (page, 1, true);
+
+  CHECK (vmstat (&st), "vmstat");
+  if (st.swap_outs == 0 || st.swap_ins == 0)
+    fail ("%u swap outs and %u swap ins", st.swap_outs, st.swap_ins);
+  msg ("pages were swapped out and in");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-zswap) begin
+(page-zswap) initialize
+(page-zswap) read/modify/write pass
+(page-zswap) read pass
+(page-zswap) vmstat
+(page-zswap) pages were swapped out and in
+(page-zswap) end
+EOF
+pass;
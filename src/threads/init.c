@@ -34,13 +34,16 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/defrag.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #include "filesys/directory.h"
 #endif
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/pagecache.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -50,12 +53,18 @@ uint32_t *init_page_dir;
 /* -f: Format the file system? */
 static bool format_filesys;
 
+/* -defrag: Defragment the file system in the background? */
+static bool defrag_filesys;
+
 /* -filesys, -scratch, -swap: Names of block devices to use,
    overriding the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
+
+/* -zswap: Size of the compressed swap cache, in kernel pages. */
+static size_t zswap_pages = ZSWAP_DEFAULT_PAGES;
 #endif
 #endif /* FILESYS */
 
@@ -63,7 +72,13 @@ static const char *swap_bdev_name;
 static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
+/* CPUID feature flag for 4 MB pages, and the CR4 bit enabling
+   them. */
+#define CPUID_PSE 0x00000008
+#define CR4_PSE 0x00000010
+
 static void paging_init (void);
+static bool cpu_has_pse (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -106,6 +121,7 @@ main (void)
 
 #ifdef VM
   frame_init();
+  pagecache_init();
 #endif
 
   /* Segmentation. */
@@ -135,12 +151,17 @@ main (void)
   ide_init ();
   locate_block_devices ();
   filesys_init (format_filesys);
+  if (defrag_filesys)
+    defrag_init ();
   /* Set the initial thread's working directory. */
   thread_current ()->working_dir = dir_open_root ();
 #endif
 
 #ifdef VM
+  zswap_init(zswap_pages);
   swap_init();
+  frame_pageout_init();
+  pagecache_writeback_init();
 #endif
 
   printf ("Boot complete.\n");
@@ -167,16 +188,39 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Returns true if the CPU supports 4 MB pages, according to the
+   PSE feature flag reported by CPUID.  See [IA32-v2a] "CPUID--CPU
+   Identification". */
+static bool
+cpu_has_pse (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & CPUID_PSE) != 0;
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.  If the CPU supports it, every 4 MB of
+   RAM that holds no kernel text is mapped with a single large
+   page, which needs no page table and one TLB entry. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  bool pse = cpu_has_pse ();
+
+  if (pse)
+    {
+      /* Turn on page size extensions, see [IA32-v3a] 2.5 "Control
+         Registers". */
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    }
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -188,6 +232,16 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      /* Kernel text must stay read-only, so its 4 MB keeps 4 kB
+         pages. */
+      if (pse && pte_idx == 0 && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || &_end_kernel_text <= vaddr))
+        {
+          pd[pde_idx] = pde_create_large_kernel (vaddr, true);
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -260,6 +314,8 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-defrag"))
+        defrag_filesys = true;
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
@@ -267,6 +323,10 @@ parse_options (char **argv)
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-zswap"))
+        zswap_pages = atoi (value);
+      else if (!strcmp (name, "-vmstats"))
+        page_exit_stats = true;
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
@@ -388,10 +448,14 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -defrag            Defragment file system in the background.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -zswap=PAGES       Cache swapped pages compressed in up to PAGES\n"
+          "                     kernel pages (0 to disable).\n"
+          "  -vmstats           Print paging statistics of exiting processes.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
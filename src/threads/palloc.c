@@ -1,14 +1,14 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,22 +23,44 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a buddy allocator.  Free pages form blocks of 2**K
+   pages aligned to 2**K pages within the pool, kept on one free
+   list per order K.  Allocating splits the smallest large enough
+   block, freeing merges a block with its free buddy, so both take
+   time logarithmic in the pool size however full it is.  The free
+   lists live in the free pages themselves. */
+
+/* Largest order of a block, 2**MAX_ORDER pages. */
+#define MAX_ORDER 20
+
+/* free_order value of a page that does not start a free block. */
+#define NOT_FREE UINT8_MAX
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    uint8_t *free_order;                /* For each page, the order of
+                                           the free block it starts,
+                                           or NOT_FREE. */
+    struct list free_lists[MAX_ORDER + 1]; /* Free blocks by order. */
   };
 
-/* Two pools: one for kernel data, one for user pages. */
+/* Two pools: one for kernel data, one for user pages.  Their free 
+   lists are protected by disabling interrupts rather than a lock, 
+   since a dying thread's page is freed while scheduling. */
 static struct pool kernel_pool, user_pool;
 
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static int block_order (size_t page_cnt);
+static void push_block (struct pool *, size_t page_idx, int order);
+static void free_block (struct pool *, size_t page_idx, int order);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -71,20 +93,37 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void *pages;
-  size_t page_idx;
+  void *pages = NULL;
+  enum intr_level old_level;
+  int order, k;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  order = block_order (page_cnt);
+  old_level = intr_disable ();
+  for (k = order; k <= MAX_ORDER; k++)
+    if (!list_empty (&pool->free_lists[k]))
+      break;
+  if (k <= MAX_ORDER)
+    {
+      size_t page_idx;
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+      pages = list_pop_front (&pool->free_lists[k]);
+      page_idx = pg_no (pages) - pg_no (pool->base);
+      pool->free_order[page_idx] = NOT_FREE;
+
+      /* Give back the upper halves of the block until it is just
+         large enough, then the pages past PAGE_CNT. */
+      while (k > order)
+        {
+          k--;
+          push_block (pool, page_idx + ((size_t) 1 << k), k);
+        }
+      free_range (pool, page_idx + page_cnt,
+                  ((size_t) 1 << order) - page_cnt);
+    }
+  intr_set_level (old_level);
 
   if (pages != NULL) 
     {
@@ -119,6 +158,7 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
   size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -137,8 +177,11 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  ASSERT (page_idx + page_cnt <= pool->page_cnt);
+  ASSERT (pool->free_order[page_idx] == NOT_FREE);
+  old_level = intr_disable ();
+  free_range (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +191,46 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void) 
+{
+  return user_pool.page_cnt;
+}
+
+/* Returns the index of PAGE, which was allocated from the user
+   pool, within the user pool. */
+size_t
+palloc_user_page_idx (void *page) 
+{
+  ASSERT (page_from_pool (&user_pool, page));
+  return pg_no (page) - pg_no (user_pool.base);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's free_order map at its base.
+     Calculate the space needed for the map
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  size_t map_pages = DIV_ROUND_UP (page_cnt, PGSIZE);
+  int k;
+  if (map_pages > page_cnt)
+    PANIC ("Not enough memory in %s for free page map.", name);
+  page_cnt -= map_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  /* Initialize the pool, with all of its pages free. */
+  p->free_order = base;
+  memset (p->free_order, NOT_FREE, page_cnt);
+  p->base = base + map_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  for (k = 0; k <= MAX_ORDER; k++)
+    list_init (&p->free_lists[k]);
+  free_range (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +240,69 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the order of the smallest block holding PAGE_CNT pages,
+   or MAX_ORDER + 1 if no block is large enough. */
+static int
+block_order (size_t page_cnt) 
+{
+  int order = 0;
+  while (order <= MAX_ORDER && ((size_t) 1 << order) < page_cnt)
+    order++;
+  return order;
+}
+
+/* Puts the free block of order ORDER at PAGE_IDX in POOL on its free
+   list, without merging it. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order) 
+{
+  struct list_elem *elem = (struct list_elem *) (pool->base 
+                                                 + PGSIZE * page_idx);
+  pool->free_order[page_idx] = order;
+  list_push_front (&pool->free_lists[order], elem);
+}
+
+/* Frees the block of order ORDER at PAGE_IDX in POOL, merging it with
+   its buddy for as long as the buddy is free as a whole. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (order < MAX_ORDER)
+    {
+      size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+      if (buddy_idx + ((size_t) 1 << order) > pool->page_cnt
+          || pool->free_order[buddy_idx] != order)
+        break;
+      list_remove ((struct list_elem *) (pool->base + PGSIZE * buddy_idx));
+      pool->free_order[buddy_idx] = NOT_FREE;
+      if (buddy_idx < page_idx)
+        page_idx = buddy_idx;
+      order++;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages at PAGE_IDX in POOL, as the largest 
+   aligned blocks they split into. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+      while (order < MAX_ORDER
+             && page_idx % ((size_t) 1 << (order + 1)) == 0
+             && ((size_t) 1 << (order + 1)) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
@@ -14,6 +14,9 @@
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
@@ -394,6 +397,11 @@ idle (void *idle_started_ UNUSED)
 
   for (;;) 
     {
+#ifdef VM
+      /* Put the spare time to use clearing free frames. */
+      frame_idle ();
+#endif
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
@@ -28,6 +28,22 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+#ifdef VM
+/* Paging events of a process, counted by vm/ and the page fault
+   handler.  The process counts its own faults and swap ins.  The
+   page-out daemon counts swap outs while holding the frame lock,
+   and mmap writebacks are counted while holding the page cache
+   lock, by whichever thread issues the write. */
+struct vm_stats
+  {
+    unsigned minor_faults;              /* Faults served from memory. */
+    unsigned major_faults;              /* Faults that read a disk. */
+    unsigned swap_ins;                  /* Pages read back from swap. */
+    unsigned swap_outs;                 /* Pages written to swap. */
+    unsigned mmap_writebacks;           /* Mapped file pages written. */
+  };
+#endif
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -111,9 +127,11 @@ struct thread
 
 #ifdef VM
     struct hash pages;                  /* The supplemental page table. */
+    struct list areas;                  /* The file mapping areas. */
     void* saved_esp;                    /* The thread's stack pointer for 
                                            kernel segfaults. */
     struct hash mmap_files;             /* Memory mapped files table. */
+    struct vm_stats vm_stats;           /* Paging statistics. */
 #endif
 
 #ifdef FILESYS
@@ -175,12 +175,17 @@ page_fault (struct intr_frame *f)
       void* esp = user ? f->esp : thread_current()->saved_esp;
       if (esp - 32 <= fault_addr) {
          // Bring in new stack page.
-         if (page_create(fault_addr, false, true)) {
+         if (page_create(fault_addr, true, true)) {
             return;
          }
       }
     } else if (not_present && (!write || page->writable) &&
-               page_try_load_in_frame(page)) {
+               page_try_load_in_frame(page, write)) {
+      return;
+    } else if (!not_present && write && page_copy_on_write(page)) {
+      /* Counted here, since pinning buffers for writes calls
+         page_copy_on_write() on pages that never faulted. */
+      page->thread->vm_stats.minor_faults++;
       return;
     }
   }
@@ -37,11 +37,15 @@ pagedir_destroy (uint32_t *pd)
     if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
+
+        /* With virtual memory, user frames belong to the frame table,
+           which freed them already. */
+#ifndef VM
         uint32_t *pte;
-        
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
           if (*pte & PTE_P) 
             palloc_free_page (pte_get_page (*pte));
+#endif
         palloc_free_page (pt);
       }
   palloc_free_page (pd);
@@ -80,6 +84,11 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
+  /* Only the kernel's memory is mapped with large pages, which have
+     no page table entry to return. */
+  if (*pde & PTE_PS)
+    return NULL;
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
@@ -156,6 +165,29 @@ pagedir_clear_page (uint32_t *pd, void *upage)
     }
 }
 
+/* Sets the writable bit to WRITABLE in the PTE for user virtual
+   page UPAGE in PD.  UPAGE need not be mapped. */
+void
+pagedir_set_writable (uint32_t *pd, void *upage, bool writable) 
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  pte = lookup_page (pd, upage, false);
+  if (pte != NULL) 
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else 
+        {
+          *pte &= ~(uint32_t) PTE_W;
+          invalidate_pagedir (pd);
+        }
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -22,12 +22,16 @@
 #ifdef VM
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/pagecache.h"
 #include "userprog/syscall.h"
 #endif
 
 static struct lock filesystem_lock;
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
+static void init_process (struct thread *t, struct process_info *info);
+static bool fork_files (struct thread *parent);
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 
 static void process_file_destroy(struct hash_elem *e, void *aux UNUSED);
@@ -99,14 +103,42 @@ start_process (void *info_aux)
   struct intr_frame if_;
   bool success;
 
-  // Store thread information for process_execute.
   struct thread *t = thread_current();
   struct process_info* info = (struct process_info*) info_aux;
+  char *file_name = info->file_name;
+  init_process (t, info);
+
+  /* Initialize interrupt frame and load executable. */
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  success = load (file_name, &if_.eip, &if_.esp);
+
+  /* If load failed, notify process_execute and quit. */
+  info->failed_loading = !success;
+  sema_up(&info->load_sema);
+  if (!success) 
+    thread_exit ();
+
+  /* Start the user process by simulating a return from an
+     interrupt, implemented by intr_exit (in
+     threads/intr-stubs.S).  Because intr_exit takes all of its
+     arguments on the stack in the form of a `struct intr_frame',
+     we just point the stack pointer (%esp) to our stack frame
+     and jump to it. */
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Initializes the process-related fields of the new process thread
+   T, and stores information about the thread for its parent. */
+static void
+init_process (struct thread *t, struct process_info *info)
+{
   info->thread = t;
   info->tid = t->tid;
-  char *file_name = info->file_name;
 
-  // Initialize process-related fields for the thread.
 #ifdef USERPROG
   t->process_info = info;
   t->fd_counter = 2;
@@ -120,30 +152,155 @@ start_process (void *info_aux)
 #ifdef FILESYS
   t->working_dir = file_reopen(info->working_dir);
 #endif
+}
 
-  /* Initialize interrupt frame and load executable. */
-  memset (&if_, 0, sizeof if_);
-  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
-  if_.cs = SEL_UCSEG;
-  if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
+/* What a forked process copies from its parent, which waits on the
+   load semaphore until the copy is done. */
+struct fork_info {
+  struct process_info *info;      /* The child's process info. */
+  struct thread *parent;          /* The forking process. */
+  struct intr_frame *frame;       /* The parent's system call frame. */
+};
+
+/* Starts a copy of the current process, which returns from the
+   system call in frame F with a return value of 0.  The child shares
+   the parent's memory copy-on-write, and gets its own handles for
+   the parent's open files, memory mapped files and working
+   directory.  Returns the child's thread id, or TID_ERROR if the
+   copy failed. */
+tid_t
+process_fork (struct intr_frame *f)
+{
+  struct thread *cur = thread_current ();
+  struct process_info *info = malloc(sizeof(struct process_info));
+  if (!info) {
+    return TID_ERROR;
+  }
+  sema_init(&info->alive_sema, 0);
+  sema_init(&info->load_sema, 0);
+  info->file_name = NULL;
+  info->exit_status = 0;
+#ifdef FILESYS
+  info->working_dir = file_reopen(cur->working_dir);
+#endif
+  list_push_back(&cur->children, &info->children_elem);
 
-  /* If load failed, notify process_execute and quit. */
+  struct fork_info fork;
+  fork.info = info;
+  fork.parent = cur;
+  fork.frame = f;
+  tid_t tid = thread_create (cur->name, PRI_DEFAULT, start_fork, &fork);
+  if (tid != TID_ERROR) {
+    /* Wait until the child copied everything. */
+    sema_down(&info->load_sema);
+    if (info->failed_loading) {
+      tid = TID_ERROR;
+    }
+  }
+  file_close(info->working_dir);
+  return tid;
+}
+
+/* A thread function that copies the forking parent process and 
+   returns to user mode as the child. */
+static void
+start_fork (void *fork_aux)
+{
+  struct fork_info *fork = fork_aux;
+  struct thread *t = thread_current ();
+  struct thread *parent = fork->parent;
+  struct process_info *info = fork->info;
+  init_process (t, info);
+
+  struct intr_frame if_ = *fork->frame;
+  if_.eax = 0;
+
+  bool success = false;
+  t->pagedir = pagedir_create ();
+  if (t->pagedir != NULL) 
+    {
+      process_activate ();
+      success = page_fork (parent) && fork_files (parent);
+    }
+
+  /* The parent may go on once nothing is copied from it anymore. */
   info->failed_loading = !success;
   sema_up(&info->load_sema);
   if (!success) 
     thread_exit ();
 
-  /* Start the user process by simulating a return from an
-     interrupt, implemented by intr_exit (in
-     threads/intr-stubs.S).  Because intr_exit takes all of its
-     arguments on the stack in the form of a `struct intr_frame',
-     we just point the stack pointer (%esp) to our stack frame
-     and jump to it. */
   asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
   NOT_REACHED ();
 }
 
+/* Reopens the open files, memory mapped files and executable of the
+   given parent process for the current process, and points the 
+   current process's pages to its own files.  Returns false if out
+   of memory. */
+static bool
+fork_files (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  bool success = false;
+  lock_acquire(&filesystem_lock);
+
+  /* Open files keep their descriptors and positions. */
+  struct hash_iterator i;
+  hash_first(&i, &parent->files);
+  while (hash_next(&i)) {
+    struct process_file *parent_file = hash_entry(hash_cur(&i), 
+                                                  struct process_file,
+                                                  files_elem);
+    struct process_file *file = malloc(sizeof(struct process_file));
+    if (!file) {
+      goto release;
+    }
+    file->file = file_reopen(parent_file->file);
+    if (!file->file) {
+      free(file);
+      goto release;
+    }
+    file_seek(file->file, file_tell(parent_file->file));
+    file->fd = parent_file->fd;
+    hash_insert(&cur->files, &file->files_elem);
+  }
+  cur->fd_counter = parent->fd_counter;
+
+  hash_first(&i, &parent->mmap_files);
+  while (hash_next(&i)) {
+    struct mmap_file *parent_mmap = hash_entry(hash_cur(&i), 
+                                               struct mmap_file, 
+                                               mmaps_elem);
+    struct mmap_file *mmap_file = malloc(sizeof(struct mmap_file));
+    if (!mmap_file) {
+      goto release;
+    }
+    mmap_file->file = file_reopen(parent_mmap->file);
+    if (!mmap_file->file) {
+      free(mmap_file);
+      goto release;
+    }
+    mmap_file->area = page_find_area(parent_mmap->area->start);
+    mmap_file->mapid = parent_mmap->mapid;
+    hash_insert(&cur->mmap_files, &mmap_file->mmaps_elem);
+    page_replace_file(parent_mmap->file, mmap_file->file);
+  }
+
+  if (parent->this_exec != NULL) {
+    cur->this_exec = file_reopen(parent->this_exec);
+    if (cur->this_exec == NULL) {
+      goto release;
+    }
+    file_deny_write(cur->this_exec);
+    page_replace_file(parent->this_exec, cur->this_exec);
+  }
+  success = true;
+
+release:
+  lock_release(&filesystem_lock);
+  return success;
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -177,6 +334,11 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
+#ifdef VM
+  if (page_exit_stats && cur->pagedir != NULL)
+    page_print_stats ();
+#endif
+
   /* If parent is alive, indicate that child is dead. */
   struct process_info* info = cur->process_info;
   if (info != NULL) {
@@ -185,12 +347,6 @@ process_exit (void)
     sema_up(&info->alive_sema);
   }
 
-  if (cur->this_exec != NULL) {
-      file_allow_write(cur->this_exec);
-      file_close(cur->this_exec);
-      cur->this_exec = NULL;
-  }
-
 #ifdef FILESYS
   if (cur->working_dir != NULL) { 
     file_close(cur->working_dir);
@@ -200,7 +356,15 @@ process_exit (void)
   /* Close all files opened by this process. */
   hash_destroy(&cur->mmap_files, process_mmap_destroy);
   hash_destroy(&cur->files, process_file_destroy);
-  hash_destroy(&cur->pages, page_destroy);
+  page_destroy_all();
+  page_destroy_areas();
+
+  /* Only close the executable once its pages are unmapped. */
+  if (cur->this_exec != NULL) {
+      file_allow_write(cur->this_exec);
+      file_close(cur->this_exec);
+      cur->this_exec = NULL;
+  }
 
 
   /* Free all children process_info. */
@@ -513,29 +677,10 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  while (read_bytes > 0 || zero_bytes > 0) 
-    {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      /* Get a page of memory. */
-      struct page* page = page_create_executable(upage, file, ofs, 
-                                                 page_read_bytes, writable);
-      if (page == NULL)
-        return false;
-
-      // page_try_load_in_frame(page);
-
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-      ofs += PGSIZE;
-    }
-  return true;
+  /* The pages are only read once they are first faulted on. */
+  size_t page_cnt = (read_bytes + zero_bytes) / PGSIZE;
+  return page_create_area (upage, page_cnt, PAGE_EXECUTABLE, file, ofs,
+                           read_bytes, writable) != NULL;
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -693,8 +838,13 @@ process_file_destroy(struct hash_elem *e, void *aux UNUSED) {
   free(file);
 }
 
+/* Maps LENGTH bytes of the file open as FD, starting at the page 
+   aligned OFFSET, at ADDR, or the rest of the file if LENGTH is 0. 
+   The mapping ends at the end of the file. FLAGS are MAP_* flags 
+   from lib/user/syscall.h. */
 mapid_t 
-process_mmap_file(int fd, void* addr) {
+process_mmap_file(int fd, void* addr, off_t offset, size_t length, 
+                  int flags) {
   mapid_t mapid = MAP_FAILED;
   struct file* file = process_get_file(fd);
   lock_acquire(&filesystem_lock);
@@ -706,11 +856,14 @@ process_mmap_file(int fd, void* addr) {
   if (!file) {
     goto release;
   }
-  off_t length = file_length(file);
-  if (length == 0) {
+  off_t file_left = file_length(file) - offset;
+  if (offset < 0 || file_left <= 0) {
     file_close(file);
     goto release;
   }
+  if (length == 0 || length > (size_t) file_left) {
+    length = file_left;
+  }
   struct mmap_file* mmap_file = malloc(sizeof(struct mmap_file));
   if (!mmap_file) {
     file_close(file);
@@ -718,29 +871,26 @@ process_mmap_file(int fd, void* addr) {
   }
 
   mmap_file->file = file;
-  mmap_file->pages = calloc(sizeof(struct page*), 
-                            (length + PGSIZE - 1) / PGSIZE);
-  if (!mmap_file->pages) {
+  page_type type = flags & MAP_PRIVATE ? PAGE_MMAP_PRIVATE : PAGE_MMAP;
+  mmap_file->area = page_create_area(addr, (length + PGSIZE - 1) / PGSIZE,
+                                     type, file, offset, length, 
+                                     !(flags & MAP_READONLY));
+  if (!mmap_file->area) {
     file_close(file);
     free(mmap_file);
     goto release;
   }
-  mmap_file->page_count = 0;
-  for (off_t i = 0; length > 0; i += PGSIZE, length -= PGSIZE) {
-    size_t size = length > PGSIZE ? PGSIZE : length;
-    struct page* page = page_create_mmap(addr + i, file, i, size);
-    if (!page) {
-      // Free pages and malloc'd memory.
-      process_mmap_free(mmap_file, true);
-      goto release;
-    }
-    mmap_file->pages[mmap_file->page_count++] = page;
-  }
 
   struct thread* curr = thread_current();
   mmap_file->mapid = curr->fd_counter++;
   hash_insert(&curr->mmap_files, &mmap_file->mmaps_elem);
   mapid = mmap_file->mapid;
+  lock_release(&filesystem_lock);
+
+  if (flags & MAP_POPULATE) {
+    page_prefetch(mmap_file->area->start, mmap_file->area->end);
+  }
+  return mapid;
 
 release:
   lock_release(&filesystem_lock);
@@ -762,24 +912,27 @@ process_mmap_close_file(mapid_t mapid) {
   process_mmap_free(file, false);
 }
 
-void
-process_mmap_write_to_disk(struct page* page) {
-  ASSERT(page->type == PAGE_MMAP);
-
-  lock_acquire(&filesystem_lock);
-  if (pagedir_is_dirty(page->thread->pagedir, page->vaddr)) {
-    file_write_at(page->file, page->frame->frame, page->length, page->offset);
+/* Writes back the pages of the given mapping written so far. Returns
+   false if there is no such mapping. */
+bool
+process_mmap_sync(mapid_t mapid) {
+  struct mmap_file mmap_file;
+  mmap_file.mapid = mapid;
+  struct hash_elem* file_ = hash_find(&thread_current()->mmap_files,
+                                      &mmap_file.mmaps_elem);
+  if (!file_) {
+    return false;
   }
-  lock_release(&filesystem_lock);
+  struct mmap_file* file = hash_entry(file_, struct mmap_file, mmaps_elem);
+  pagecache_sync(file_get_inode(file->file));
+  return true;
 }
 
-/* Given a mmap_file, frees all allocated pages, the page list,
-   and, the mmap_file itself. */
+/* Given a mmap_file, frees its area with all of its pages, and the
+   mmap_file itself. */
 static void 
 process_mmap_free(struct mmap_file* mmap_file, bool lock_owned) {
-  for (size_t i = 0; i < mmap_file->page_count; i++) {
-    page_free(mmap_file->pages[i]);
-  }
+  page_free_area(mmap_file->area);
 
   if (!lock_owned) {
     lock_acquire(&filesystem_lock);
@@ -787,7 +940,6 @@ process_mmap_free(struct mmap_file* mmap_file, bool lock_owned) {
     ASSERT(lock_held_by_current_thread(&filesystem_lock));
   }
 
-  free(mmap_file->pages);
   file_close(mmap_file->file);
   if (!lock_owned) {
     lock_release(&filesystem_lock);
@@ -1,6 +1,7 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "filesys/file.h"
 #ifdef VM
@@ -40,8 +41,7 @@ struct process_file {
 #ifdef VM
 struct mmap_file {
   mapid_t mapid;               /* The map id for this mmap'd file. */
-  struct page** pages;         /* The array of mmap'd pages. */
-  size_t page_count;           /* Page count. */
+  struct area* area;           /* The area of the mmap'd pages. */
   struct file* file;           /* The file that this mmap represents. */
 
   /* Owned by userprog/process.c. */
@@ -57,12 +57,14 @@ unsigned process_fd_hash_func(const struct hash_elem *e, void *aux UNUSED);
 bool process_fd_less_func(const struct hash_elem *a, 
                           const struct hash_elem *b, void *aux UNUSED);
 
-mapid_t process_mmap_file(int fd, void* addr);
+mapid_t process_mmap_file(int fd, void* addr, off_t offset, size_t length,
+                          int flags);
 void process_mmap_close_file(mapid_t mapid);
-void process_mmap_write_to_disk(struct page* page);
+bool process_mmap_sync(mapid_t mapid);
 struct lock* process_get_filesys_lock(void);
 
 tid_t process_execute (const char *file_name);
+tid_t process_fork (struct intr_frame *f);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
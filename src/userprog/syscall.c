@@ -6,6 +6,7 @@
 #include "userprog/process.h"
 #include "filesys/directory.h"
 #include "devices/shutdown.h"
+#include <round.h>
 #include <string.h>
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
@@ -23,10 +24,15 @@
 #define READ_ERROR 0xFFFFFFFF
 #define CODE_SEGMENT ((void*) 0x08048000)
 #define SYSCALL_EXIT_FAILURE -1
+/* The most bytes of a user buffer pinned at once for file I/O. */
+#define PIN_CHUNK_SIZE (32 * PGSIZE)
 
 struct lock* filesystem_lock;
 
 static void syscall_handler (struct intr_frame *);
+static bool copy_from_user (void* dst, const void* usrc, size_t size);
+static bool copy_to_user (void* udst, const void* src, size_t size);
+static bool is_user_range (const void* uaddr, size_t size);
 
 void
 syscall_init (void)
@@ -54,21 +60,66 @@ get_byte_or_die (const uint8_t* uaddr)
   return result;
 }
 
-/* Reads a dword (4 bytes) at user virtual address UADDR.
-   UADDR must be below PHYS_BASE.
-   Returns the dword value if successful, or exits the
+/* Reads a dword (4 bytes) at user virtual address UADDR in a 
+   single access. Returns the dword value if successful, or exits the
    program if there was a segfault. */
 static uint32_t
 get_dword_or_die (uint8_t *uaddr)
 {
-  uint32_t value = 0;
-  uint8_t* dest = (uint8_t*) &value;
-  for (size_t size = sizeof(uint32_t); size > 0; size--, dest++, uaddr++) {
-    *dest = get_byte_or_die(uaddr);
+  if (!is_user_range(uaddr, sizeof(uint32_t))) {
+    exit(SYSCALL_EXIT_FAILURE);
+  }
+  // The fault handler jumps to 1 with EAX set to READ_ERROR, skipping
+  // the clearing of EAX.
+  uint32_t error;
+  uint32_t value;
+  asm ("movl $1f, %0; movl %2, %1; xorl %0, %0; 1:"
+       : "=&a" (error), "=&r" (value) : "m" (*(uint32_t*) uaddr));
+  if (error != 0) {
+    exit(SYSCALL_EXIT_FAILURE);
   }
   return value;
 }
 
+/* Copies SIZE bytes from user virtual address USRC to kernel address
+   DST, with a single fault recovery for the whole copy. Returns false
+   if part of the user range is not accessible. */
+static bool
+copy_from_user (void* dst, const void* usrc, size_t size)
+{
+  if (!is_user_range(usrc, size)) {
+    return false;
+  }
+  uint32_t error;
+  asm volatile ("movl $1f, %0; rep movsb; xorl %0, %0; 1:"
+                : "=&a" (error), "+S" (usrc), "+D" (dst), "+c" (size)
+                : : "memory");
+  return error == 0;
+}
+
+/* Copies SIZE bytes from kernel address SRC to user virtual address 
+   UDST, with a single fault recovery for the whole copy. Returns false
+   if part of the user range is not writable. */
+static bool
+copy_to_user (void* udst, const void* src, size_t size)
+{
+  if (!is_user_range(udst, size)) {
+    return false;
+  }
+  uint32_t error;
+  asm volatile ("movl $1f, %0; rep movsb; xorl %0, %0; 1:"
+                : "=&a" (error), "+S" (src), "+D" (udst), "+c" (size)
+                : : "memory");
+  return error == 0;
+}
+
+/* Returns whether the SIZE bytes at UADDR all lie in user memory. */
+static bool
+is_user_range (const void* uaddr, size_t size)
+{
+  return is_user_vaddr(uaddr) && (size_t) (PHYS_BASE - uaddr) >= size;
+}
+
 static void
 syscall_handler (struct intr_frame *f) 
 {
@@ -185,37 +236,139 @@ syscall_handler (struct intr_frame *f)
       f->eax = inumber(fd);
       break;
     }
+    case SYS_CLONE_FILE: {
+      const char* source = (const char*) get_dword_or_die(f->esp + 4);
+      const char* target = (const char*) get_dword_or_die(f->esp + 8);
+      f->eax = clone_file(source, target);
+      break;
+    }
+    case SYS_SET_COMPRESSED: {
+      int fd = get_dword_or_die(f->esp + 4);
+      bool compressed = get_dword_or_die(f->esp + 8);
+      f->eax = set_compressed(fd, compressed);
+      break;
+    }
+    case SYS_FORK: {
+      // The child returns from this very frame, so it is passed on.
+      f->eax = process_fork(f);
+      break;
+    }
+    case SYS_MSYNC: {
+      mapid_t mapid = get_dword_or_die(f->esp + 4);
+      f->eax = msync(mapid);
+      break;
+    }
+    case SYS_MMAP_RANGE: {
+      int fd = get_dword_or_die(f->esp + 4);
+      void* addr = (void*) get_dword_or_die(f->esp + 8);
+      unsigned offset = get_dword_or_die(f->esp + 12);
+      unsigned length = get_dword_or_die(f->esp + 16);
+      int flags = get_dword_or_die(f->esp + 20);
+      f->eax = mmap_range(fd, addr, offset, length, flags);
+      break;
+    }
+    case SYS_MADVISE: {
+      void* addr = (void*) get_dword_or_die(f->esp + 4);
+      unsigned length = get_dword_or_die(f->esp + 8);
+      int advice = get_dword_or_die(f->esp + 12);
+      f->eax = madvise(addr, length, advice);
+      break;
+    }
+    case SYS_VMSTAT: {
+      struct vmstat* stat = (struct vmstat*) get_dword_or_die(f->esp + 4);
+      f->eax = vmstat(stat);
+      break;
+    }
     default: {
       exit(SYSCALL_EXIT_FAILURE);
     }
   }
 }
 
+/* Checks that the user page containing UADDR is accessible, and 
+   WRITABLE if asked, or exits the program. Pages known to the 
+   supplemental page table are checked there, any other page is 
+   probed once so the page fault handler may grow the stack. */
+static void
+check_page_or_die(const void* uaddr, bool writable) {
+  if (!is_user_vaddr(uaddr)) {
+    exit(SYSCALL_EXIT_FAILURE);
+  }
+#ifdef VM
+  /* Pages of areas are only looked up, not created. */
+  bool page_writable;
+  if (page_exists((void*) uaddr, &page_writable)) {
+    if (writable && !page_writable) {
+      exit(SYSCALL_EXIT_FAILURE);
+    }
+    return;
+  }
+#endif
+  get_byte_or_die(uaddr);
+#ifdef VM
+  if (!page_exists((void*) uaddr, &page_writable)
+      || (writable && !page_writable)) {
+    exit(SYSCALL_EXIT_FAILURE);
+  }
+#endif
+}
+
 /* Checks that the given string address is properly 
    accessable until its first null terminator, or 
    exits the program if there is a segfault. */
 static void
 check_string_or_die(const char* str) {
-  char* address = (char*) str;
-  while (get_byte_or_die((void*) address) != '\0') {
-    address++;
+  const char* address = str;
+  for (;;) {
+    check_page_or_die(address, false);
+    // The rest of the page is known to be accessible.
+    const char* page_end = pg_round_down(address) + PGSIZE;
+    for (; address < page_end; address++) {
+      if (*address == '\0') {
+        return;
+      }
+    }
   }
 }
 
-/* Checks that the given string address is properly 
-   accessable until the byte at offset size, or 
-   exits the program if there is a segfault. */
+/* Checks that the given buffer is properly accessable, and WRITABLE 
+   if asked, until the byte at offset size, or exits the program if 
+   there is a segfault. Checks a page at a time. */
 static void
-check_buffer_or_die(const void* buffer, unsigned size) {
-  void* address = (void*) buffer;
-  unsigned read = 0;
-  while (read < size) {
-    get_byte_or_die(address);
-    read++;
-    address++;
+check_buffer_or_die(const void* buffer, unsigned size, bool writable) {
+  if (size == 0) {
+    return;
+  }
+  if (!is_user_range(buffer, size)) {
+    exit(SYSCALL_EXIT_FAILURE);
+  }
+  const uint8_t* address = pg_round_down(buffer);
+  const uint8_t* end = (const uint8_t*) buffer + size;
+  for (; address < end; address += PGSIZE) {
+    check_page_or_die(address, writable);
   }
 }
 
+/* Pins the pages of the given user buffer in memory, WRITABLE if 
+   asked, so file I/O under the file system lock never faults on it,
+   or exits the program if that fails. */
+static void
+pin_buffer_or_die(void* buffer, unsigned size, bool writable) {
+#ifdef VM
+  if (!page_pin_range(buffer, size, writable)) {
+    exit(SYSCALL_EXIT_FAILURE);
+  }
+#endif
+}
+
+/* Unpins the pages of a buffer pinned by pin_buffer_or_die. */
+static void
+unpin_buffer(void* buffer, unsigned size) {
+#ifdef VM
+  page_unpin_range(buffer, size);
+#endif
+}
+
 void
 halt(void) {
   shutdown_power_off();
@@ -292,13 +445,15 @@ filesize(int fd) {
 
 int
 read(int fd, void* buffer, unsigned size) {
-  check_buffer_or_die(buffer, size);
+  check_buffer_or_die(buffer, size, true);
   if (fd == STDIN_FILENO) {
+    pin_buffer_or_die(buffer, size, true);
     lock_acquire(filesystem_lock);
     for (unsigned i = 0; i < size; i++) {
       ((char*) buffer)[i] = input_getc();
     }
     lock_release(filesystem_lock);
+    unpin_buffer(buffer, size);
     return (int) size;
   }
   // Process functions are already synchronized.
@@ -306,19 +461,47 @@ read(int fd, void* buffer, unsigned size) {
   if (file == NULL || file_is_dir(file)) {
     return -1;
   }
-  lock_acquire(filesystem_lock);
-  int bytes = file_read(file, buffer, size);
-  lock_release(filesystem_lock);
-  return bytes;
+  // Pin a chunk at a time, so large buffers can't pin all of memory.
+  unsigned bytes = 0;
+  while (bytes < size) {
+    unsigned chunk = size - bytes < PIN_CHUNK_SIZE ? size - bytes 
+                                                   : PIN_CHUNK_SIZE;
+    pin_buffer_or_die(buffer + bytes, chunk, true);
+    lock_acquire(filesystem_lock);
+    int cnt = file_read(file, buffer + bytes, chunk);
+    lock_release(filesystem_lock);
+    unpin_buffer(buffer + bytes, chunk);
+    bytes += cnt;
+    if ((unsigned) cnt < chunk) {
+      break;
+    }
+  }
+  return (int) bytes;
 }
 
 int
 write (int fd, const void *buffer, unsigned size) {
-  check_buffer_or_die(buffer, size);
+  check_buffer_or_die(buffer, size, false);
   if (fd == STDOUT_FILENO) {
-    lock_acquire(filesystem_lock);
-    putbuf(buffer, size);
-    lock_release(filesystem_lock);
+    // Copy into the kernel a page at a time, so the console is never
+    // held across a page fault.
+    size_t chunk_size = size < PGSIZE ? size : PGSIZE;
+    char* chunk = malloc(chunk_size);
+    if (chunk == NULL) {
+      return -1;
+    }
+    for (unsigned written = 0; written < size; written += chunk_size) {
+      size_t cnt = size - written < chunk_size ? size - written 
+                                               : chunk_size;
+      if (!copy_from_user(chunk, buffer + written, cnt)) {
+        free(chunk);
+        exit(SYSCALL_EXIT_FAILURE);
+      }
+      lock_acquire(filesystem_lock);
+      putbuf(chunk, cnt);
+      lock_release(filesystem_lock);
+    }
+    free(chunk);
     return (int) size;
   }
   // Process functions are already synchronized.
@@ -326,10 +509,23 @@ write (int fd, const void *buffer, unsigned size) {
   if (file == NULL || file_is_dir(file)) {
     return -1;
   }
-  lock_acquire(filesystem_lock);
-  int bytes = file_write(file, buffer, size);
-  lock_release(filesystem_lock);
-  return bytes;
+  // Pin a chunk at a time, so large buffers can't pin all of memory.
+  unsigned bytes = 0;
+  while (bytes < size) {
+    unsigned chunk = size - bytes < PIN_CHUNK_SIZE ? size - bytes 
+                                                   : PIN_CHUNK_SIZE;
+    void* chunk_start = (void*) buffer + bytes;
+    pin_buffer_or_die(chunk_start, chunk, false);
+    lock_acquire(filesystem_lock);
+    int cnt = file_write(file, chunk_start, chunk);
+    lock_release(filesystem_lock);
+    unpin_buffer(chunk_start, chunk);
+    bytes += cnt;
+    if ((unsigned) cnt < chunk) {
+      break;
+    }
+  }
+  return (int) bytes;
 }
 
 void
@@ -365,18 +561,7 @@ close(int fd) {
 
 mapid_t
 mmap(int fd, void *addr) {
-#ifdef VM
-  if (addr < CODE_SEGMENT || !is_user_vaddr(addr) || 
-      pg_round_down(addr) != addr || fd == STDIN_FILENO 
-      || fd == STDOUT_FILENO) {
-    return MAP_FAILED;
-  }
-  // Process functions are already synchronized.
-  mapid_t mapid = process_mmap_file(fd, addr);
-  return mapid;
-#else
-  return MAP_FAILED;
-#endif
+  return mmap_range(fd, addr, 0, 0, MAP_SHARED);
 }
 
 void
@@ -417,15 +602,18 @@ mkdir(const char *dir) {
 
 bool
 readdir(int fd, char *name) {
-  check_buffer_or_die(name, READDIR_MAX_LEN + 1);
   // Process functions are already synchronized.
   struct file* file = process_get_file(fd);
   if (file == NULL || !file_is_dir(file)) {
     return false;
   }
+  char kname[READDIR_MAX_LEN + 1];
   lock_acquire(filesystem_lock);
-  bool success = dir_readdir(file, name);
+  bool success = dir_readdir(file, kname);
   lock_release(filesystem_lock);
+  if (success && !copy_to_user(name, kname, strlen(kname) + 1)) {
+    exit(SYSCALL_EXIT_FAILURE);
+  }
   return success;
 }
 
@@ -448,3 +636,102 @@ inumber(int fd) {
   }
   return (int) file_get_inumber(file);
 }
+
+bool
+clone_file(const char *source, const char *target) {
+  check_string_or_die(source);
+  check_string_or_die(target);
+  lock_acquire(filesystem_lock);
+  bool success = filesys_clone(source, target);
+  lock_release(filesystem_lock);
+  return success;
+}
+
+bool
+set_compressed(int fd, bool compressed) {
+  // Process functions are already synchronized.
+  struct file* file = process_get_file(fd);
+  if (file == NULL) {
+    return false;
+  }
+  lock_acquire(filesystem_lock);
+  bool success = inode_set_compressed(file_get_inode(file), compressed);
+  lock_release(filesystem_lock);
+  return success;
+}
+
+bool
+msync(mapid_t mapid) {
+#ifdef VM
+  // Process functions are already synchronized.
+  return process_mmap_sync(mapid);
+#else
+  return false;
+#endif
+}
+
+mapid_t
+mmap_range(int fd, void *addr, unsigned offset, unsigned length, int flags) {
+#ifdef VM
+  if (addr < CODE_SEGMENT || !is_user_vaddr(addr) || 
+      pg_round_down(addr) != addr || fd == STDIN_FILENO 
+      || fd == STDOUT_FILENO || pg_ofs((void*) offset) != 0 ||
+      (flags & ~(MAP_PRIVATE | MAP_READONLY | MAP_POPULATE)) != 0) {
+    return MAP_FAILED;
+  }
+  // Process functions are already synchronized.
+  mapid_t mapid = process_mmap_file(fd, addr, offset, length, flags);
+  return mapid;
+#else
+  return MAP_FAILED;
+#endif
+}
+
+bool
+madvise(void *addr, unsigned length, int advice) {
+#ifdef VM
+  if (length > (uintptr_t) PHYS_BASE) {
+    return false;
+  }
+  void* end = addr + ROUND_UP(length, PGSIZE);
+  if (addr < CODE_SEGMENT || pg_ofs(addr) != 0 || end < addr ||
+      !is_user_vaddr(end - 1)) {
+    return false;
+  }
+  switch (advice) {
+    case MADV_NORMAL:
+      page_advise(addr, end, PAGE_ADVICE_NORMAL);
+      return true;
+    case MADV_RANDOM:
+      page_advise(addr, end, PAGE_ADVICE_RANDOM);
+      return true;
+    case MADV_SEQUENTIAL:
+      page_advise(addr, end, PAGE_ADVICE_SEQUENTIAL);
+      return true;
+    case MADV_WILLNEED:
+      page_prefetch(addr, end);
+      return true;
+    case MADV_DONTNEED:
+      page_discard(addr, end);
+      return true;
+    default:
+      return false;
+  }
+#else
+  return false;
+#endif
+}
+
+bool
+vmstat(struct vmstat *stat) {
+#ifdef VM
+  struct vmstat kstat;
+  page_get_stats(&kstat);
+  if (!copy_to_user(stat, &kstat, sizeof kstat)) {
+    exit(SYSCALL_EXIT_FAILURE);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
@@ -1,106 +1,688 @@
 #include "vm/frame.h"
 #include "threads/palloc.h"
 #include <debug.h>
+#include <string.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include <stdbool.h>
 #include "userprog/pagedir.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "lib/stdio.h"
 #include "vm/swap.h"
 #include "vm/page.h"
+#include "vm/pagecache.h"
 #include "userprog/process.h"
 
-/* The list of all kernel frames. */
-static struct list frames;
-/* The count of frames in the frame list. */
+/* The frame table, one entry per page of the user pool, indexed by
+   the page's index in the pool. */
+static struct frame* frames;
+/* The count of entries in the frame table. */
 static size_t frame_count;
-/* Aquired whenever the frame list is modified. */
+/* The next frame the clock hand looks at for eviction. */
+static size_t clock_hand;
+/* A page of zeros, mapped read only by untouched anonymous pages. */
+static void* zero_page;
+/* Aquired whenever the frame table, or a frame's page list, is 
+   modified. */
 static struct lock frame_lock;
 
+/* Once user memory runs out, the page-out daemon evicts frames into
+   this pool until it holds FREE_FRAMES_HIGH frames, and is woken up
+   whenever it drops below FREE_FRAMES_LOW. */
+#define FREE_FRAMES_LOW 4
+#define FREE_FRAMES_HIGH 16
+/* Evicted frames ready to be allocated. */
+static struct list free_frames;
+/* The count of frames in the free frame pool. */
+static size_t free_frame_count;
+/* While the CPU is idle, this pool is filled with up to 
+   ZERO_FRAMES_TARGET frames of free memory already filled with 
+   zeros, so zero-fill faults don't have to clear a page. */
+#define ZERO_FRAMES_TARGET 8
+static struct list zero_frames;
+/* The count of frames in the zeroed frame pool. */
+static size_t zero_frame_count;
+/* Whether the zeroing thread was woken up and hasn't finished. */
+static bool zeroing_requested;
+/* Upped to wake up the zeroing thread. */
+static struct semaphore zeroing_sema;
+/* Whether the page-out daemon was woken up and hasn't finished. */
+static bool pageout_requested;
+/* Upped to wake up the page-out daemon. */
+static struct semaphore pageout_sema;
+/* Broadcast when frames are added to the pool, or a page finished
+   being written to swap. */
+static struct condition frames_changed;
+
 static struct frame* _frame_allocate(bool zeros);
-static bool _evict_frame(void);
+static size_t _evict_frames(size_t want);
+static void _cluster_insert(struct page** pages, 
+                            struct frame** cluster_frames, size_t cnt, struct page* page,
+                            struct frame* frame);
 static void _frame_free(struct frame* frame, bool lock_owned); 
+static bool _frame_accessed(struct frame* frame);
+static bool _frame_dirty(struct frame* frame);
+static void _frame_unmap_evicting(struct frame* frame);
+static void _frame_to_pool(struct frame* frame);
+static struct frame* _frame_pop(struct list* pool, size_t* cnt);
+static void _request_pageout(void);
+static void pageout_daemon(void* aux UNUSED);
+static void zeroing_thread(void* aux UNUSED);
 
 void frame_init() {
-    list_init(&frames);
+    frame_count = palloc_user_page_cnt();
+    frames = calloc(frame_count, sizeof(struct frame));
+    if (!frames && frame_count > 0) {
+        PANIC("Can't allocate the frame table!");
+    }
+    for (size_t i = 0; i < frame_count; i++) {
+        frames[i].state = FRAME_UNUSED;
+        list_init(&frames[i].pages);
+    }
+    zero_page = palloc_get_page(PAL_ZERO | PAL_ASSERT);
+    clock_hand = 0;
+    list_init(&free_frames);
     lock_init(&frame_lock);
-    frame_count = 0;
+    sema_init(&pageout_sema, 0);
+    cond_init(&frames_changed);
+    free_frame_count = 0;
+    pageout_requested = false;
+    list_init(&zero_frames);
+    sema_init(&zeroing_sema, 0);
+    zero_frame_count = 0;
+    zeroing_requested = false;
 }
 
+/* Starts the page-out daemon, once swap is available, and the thread
+   that fills the zeroed frame pool. */
+void frame_pageout_init() {
+    thread_create("pageout", PRI_DEFAULT, pageout_daemon, NULL);
+    thread_create("zeroing", PRI_MIN, zeroing_thread, NULL);
+}
+
+/* Called by the idle thread whenever the CPU has nothing else to do.
+   Wakes up the zeroing thread if the zeroed frame pool needs filling,
+   without taking any lock, since the idle thread must never block. */
+void frame_idle() {
+    if (zero_frame_count < ZERO_FRAMES_TARGET && !zeroing_requested) {
+        zeroing_requested = true;
+        sema_up(&zeroing_sema);
+    }
+}
+
+/* Returns the shared zero page. It is not part of the frame table,
+   so it is never evicted, and must never be written. */
+void* frame_zero_page() {
+    return zero_page;
+}
+
+/* Allocates a frame. The frame is returned pinned, and must be
+   unpinned once it is mapped or owned by the page cache. */
 struct frame* frame_allocate() {
     return _frame_allocate(false);
 }
 
+/* Allocates a pinned frame, filled with zeros. */
 struct frame* frame_allocate_zeros() {
     return _frame_allocate(true); 
 }
 
 static struct frame* _frame_allocate(bool zeros) {
+    // Zeros can't be told apart from data the kernel wrote.
+    bool dirty = zeros;
     lock_acquire(&frame_lock);
     struct frame* new_frame = NULL;
-    void* page = palloc_get_page(PAL_USER | (zeros ? PAL_ZERO : 0));
-    if (!page) {
+    // Zero-fill faults take a frame cleared ahead of time, if any.
+    if (zeros && !list_empty(&zero_frames)) {
+        new_frame = _frame_pop(&zero_frames, &zero_frame_count);
+        zeros = false;
+    }
+    void* page = NULL;
+    if (!new_frame) {
+        page = palloc_get_page(PAL_USER | (zeros ? PAL_ZERO : 0));
+    }
+    if (page) {
+        new_frame = &frames[palloc_user_page_idx(page)];
+        ASSERT(new_frame->state == FRAME_UNUSED);
+        new_frame->frame = page;
+    } else if (!new_frame && !list_empty(&zero_frames) && 
+               list_empty(&free_frames)) {
+        // Free memory is all in the zeroed pool.
+        new_frame = _frame_pop(&zero_frames, &zero_frame_count);
+    } else if (!new_frame) {
         // This town ain't big enough for the both of us >:(
-        if (!_evict_frame()) {
-            lock_release(&frame_lock);
-            return NULL;
+        // Take an evicted frame instead, waiting for the page-out
+        // daemon if there is none yet.
+        while (list_empty(&free_frames)) {
+            _request_pageout();
+            cond_wait(&frames_changed, &frame_lock);
         }
-        page = palloc_get_page(PAL_USER | (zeros ? PAL_ZERO : 0));
-        if (!page) {
+        new_frame = _frame_pop(&free_frames, &free_frame_count);
+        if (free_frame_count < FREE_FRAMES_LOW) {
+            _request_pageout();
+        }
+        if (zeros) {
+            memset(new_frame->frame, 0, PGSIZE);
+        }
+    }
+
+    new_frame->state = FRAME_USED;
+    new_frame->pin_cnt = 1;
+    new_frame->cache = NULL;
+    new_frame->dirty = dirty;
+    ASSERT(list_empty(&new_frame->pages));
+
+    lock_release(&frame_lock);
+    return new_frame;
+}
+
+/* Takes the first frame out of the given pool, whose count of frames 
+   is at CNT. */
+static struct frame* 
+_frame_pop(struct list* pool, size_t* cnt) {
+    ASSERT(lock_held_by_current_thread(&frame_lock));
+    struct frame* frame = list_entry(list_pop_front(pool), 
+                                     struct frame, free_elem);
+    (*cnt)--;
+    ASSERT(frame->state == FRAME_POOLED);
+    return frame;
+}
+
+/* Evicts up to WANT frames into the free frame pool, choosing them 
+   with the clock algorithm. Dirty private frames are collected into
+   a cluster and written to adjacent swap slots at once, and dirty 
+   page cache frames are collected to be written back to their files,
+   without holding the frame lock so faults on other pages aren't 
+   stalled behind the writes. Returns the count of frames evicted. */
+static size_t _evict_frames(size_t want) {
+    ASSERT (lock_held_by_current_thread(&frame_lock));
+
+    struct page* cluster[SWAP_CLUSTER];
+    struct frame* cluster_frames[SWAP_CLUSTER];
+    size_t cluster_cnt = 0;
+    struct frame* cache_frames[SWAP_CLUSTER];
+    size_t cache_cnt = 0;
+    size_t evicted = 0;
+
+    // Page cache frames still mapped by a process are shared by 
+    // every process running the same executable or mapping the same
+    // file, so the first pass leaves them alone. They may also be 
+    // skipped if the page cache is busy, so allow for two more passes
+    // over the frames.
+    for (size_t count = 0; count < 3 * frame_count + 1 && 
+         evicted + cluster_cnt + cache_cnt < want && 
+         cluster_cnt < SWAP_CLUSTER && cache_cnt < SWAP_CLUSTER; 
+         count++) {
+        if (count > 0 && count % frame_count == 0) {
+            // Threads holding the page cache may be waiting for the
+            // frame lock, so let them finish before the next pass.
+            // The frames collected so far are pinned meanwhile.
             lock_release(&frame_lock);
-            return NULL;
+            thread_yield();
+            lock_acquire(&frame_lock);
+        }
+        struct frame* frame = &frames[clock_hand];
+        clock_hand = (clock_hand + 1) % frame_count;
+        if (frame->state != FRAME_USED || frame->pin_cnt > 0) {
+            continue;
+        }
+
+        if (frame->cache) {
+            switch (pagecache_try_evict(frame, count >= frame_count)) {
+            case PAGECACHE_EVICTED:
+                _frame_to_pool(frame);
+                evicted++;
+                break;
+            case PAGECACHE_WRITE:
+                // Pinned, which keeps it from being chosen again.
+                cache_frames[cache_cnt++] = frame;
+                break;
+            case PAGECACHE_KEPT:
+                break;
+            }
+        } else if (!list_empty(&frame->pages) && !_frame_accessed(frame)) {
+            // Unmap the pages before writing the frame, so no writes 
+            // to it can be lost. A fault on them waits for the write.
+            enum intr_level old_level = intr_disable();
+            bool dirty = _frame_dirty(frame);
+            if (dirty) {
+                _frame_unmap_evicting(frame);
+            } else {
+                frame_unmap(frame);
+            }
+            intr_set_level(old_level);
+
+            if (dirty) {
+                // Keeps the frame from being chosen again.
+                frame->pin_cnt++;
+                struct page* page = list_entry(list_front(&frame->pages), 
+                                               struct page, frame_elem);
+                _cluster_insert(cluster, cluster_frames, cluster_cnt,
+                                page, frame);
+                cluster_cnt++;
+            } else {
+                _frame_to_pool(frame);
+                evicted++;
+            }
         }
     }
 
-    if (!new_frame) {
-        new_frame = calloc(sizeof(struct frame), 1);
-        if (!new_frame) {
-            palloc_free_page(page);
+    if (cluster_cnt == 0 && cache_cnt == 0) {
+        return evicted;
+    }
+    block_sector_t sectors[SWAP_CLUSTER];
+    if (cluster_cnt > 0) {
+        lock_release(&frame_lock);
+        swap_write(cluster, cluster_frames, cluster_cnt, sectors);
+        lock_acquire(&frame_lock);
+    }
+    // Finish the private pages before taking the page cache to write
+    // back cache frames, since an exiting process waits for them to
+    // stop being evicted while it holds the page cache.
+    for (size_t i = 0; i < cluster_cnt; i++) {
+        struct frame* frame = cluster_frames[i];
+        // Pages sharing the frame since fork share the slot.
+        bool first = true;
+        while (!list_empty(&frame->pages)) {
+            struct page* page = list_entry(list_pop_front(&frame->pages),
+                                           struct page, frame_elem);
+            if (!first) {
+                swap_share(sectors[i]);
+            }
+            first = false;
+            page->swap_sector = sectors[i];
+            page->swapped = true;
+            page->evicting = false;
+            page->thread->vm_stats.swap_outs++;
+        }
+        frame->pin_cnt--;
+        _frame_to_pool(frame);
+    }
+    evicted += cluster_cnt;
+    if (cache_cnt > 0) {
+        lock_release(&frame_lock);
+        pagecache_write_evicted(cache_frames, cache_cnt);
+        lock_acquire(&frame_lock);
+    }
+    for (size_t i = 0; i < cache_cnt; i++) {
+        struct frame* frame = cache_frames[i];
+        frame->pin_cnt--;
+        // Still cached if it was used again while being written.
+        if (!frame->cache) {
+            _frame_to_pool(frame);
+            evicted++;
+        }
+    }
+    return evicted;
+}
+
+/* Returns whether any of the pages mapping the given private frame
+   accessed it since the last check, resetting their accessed bits. */
+static bool
+_frame_accessed(struct frame* frame) {
+    bool accessed = false;
+    for (struct list_elem* e = list_begin(&frame->pages);
+         e != list_end(&frame->pages); e = list_next(e)) {
+        struct page* page = list_entry(e, struct page, frame_elem);
+        uint32_t* pd = page->thread->pagedir;
+        if (pagedir_is_accessed(pd, page->vaddr)) {
+            accessed = true;
+            // Reset accessed state.
+            pagedir_set_accessed(pd, page->vaddr, false);
+        }
+    }
+    return accessed;
+}
+
+/* Returns whether the given private frame was written through any 
+   of its pages, or by the kernel. The kernel's writes go through its
+   own mapping of the frame, which may be a large page without a dirty
+   bit of its own, so they are tracked in the frame instead. */
+static bool
+_frame_dirty(struct frame* frame) {
+    bool dirty = frame->dirty;
+    for (struct list_elem* e = list_begin(&frame->pages);
+         e != list_end(&frame->pages); e = list_next(e)) {
+        struct page* page = list_entry(e, struct page, frame_elem);
+        dirty = dirty || pagedir_is_dirty(page->thread->pagedir, page->vaddr);
+    }
+    return dirty;
+}
+
+/* Removes the given private frame from the page tables of all of its
+   pages and marks them as being evicted. Unlike frame_unmap, the 
+   pages stay in the frame's list, so all of them can be pointed to 
+   the swap slot once the frame is written. */
+static void
+_frame_unmap_evicting(struct frame* frame) {
+    ASSERT(lock_held_by_current_thread(&frame_lock));
+    for (struct list_elem* e = list_begin(&frame->pages);
+         e != list_end(&frame->pages); e = list_next(e)) {
+        struct page* page = list_entry(e, struct page, frame_elem);
+        page->frame = NULL;
+        page->evicting = true;
+        pagedir_clear_page(page->thread->pagedir, page->vaddr);
+    }
+}
+
+/* Inserts the given page and its frame into the first CNT entries of
+   a swap cluster, keeping it sorted by process and virtual address so
+   that neighbouring pages of a process get neighbouring slots. */
+static void
+_cluster_insert(struct page** pages, struct frame** cluster_frames, 
+                size_t cnt, struct page* page, struct frame* frame) {
+    size_t i = cnt;
+    for (; i > 0; i--) {
+        struct page* prev = pages[i - 1];
+        if (prev->thread < page->thread || 
+            (prev->thread == page->thread && prev->vaddr < page->vaddr)) {
+            break;
+        }
+        pages[i] = prev;
+        cluster_frames[i] = cluster_frames[i - 1];
+    }
+    pages[i] = page;
+    cluster_frames[i] = frame;
+}
+
+/* Adds the given unmapped frame to the free frame pool. */
+static void
+_frame_to_pool(struct frame* frame) {
+    ASSERT(lock_held_by_current_thread(&frame_lock));
+    ASSERT(list_empty(&frame->pages));
+    frame->state = FRAME_POOLED;
+    list_push_back(&free_frames, &frame->free_elem);
+    free_frame_count++;
+    cond_broadcast(&frames_changed, &frame_lock);
+}
+
+/* Wakes up the page-out daemon, unless it is already running. */
+static void
+_request_pageout() {
+    ASSERT(lock_held_by_current_thread(&frame_lock));
+    if (!pageout_requested) {
+        pageout_requested = true;
+        sema_up(&pageout_sema);
+    }
+}
+
+/* Fills the free frame pool up to the high watermark whenever it is
+   woken up. */
+static void
+pageout_daemon(void* aux UNUSED) {
+    for (;;) {
+        sema_down(&pageout_sema);
+        lock_acquire(&frame_lock);
+        while (free_frame_count < FREE_FRAMES_HIGH) {
+            if (_evict_frames(FREE_FRAMES_HIGH - free_frame_count) == 0) {
+                if (list_empty(&free_frames)) {
+                    PANIC("Failed to evict a frame!");
+                }
+                break;
+            }
+        }
+        pageout_requested = false;
+        lock_release(&frame_lock);
+    }
+}
+
+/* Fills the zeroed frame pool from free memory. It is only woken up
+   from idle(), once the CPU had nothing else to do, but then takes 
+   turns on the CPU with every other ready thread until the pool is
+   full. */
+static void
+zeroing_thread(void* aux UNUSED) {
+    for (;;) {
+        sema_down(&zeroing_sema);
+        lock_acquire(&frame_lock);
+        while (zero_frame_count < ZERO_FRAMES_TARGET) {
+            // Never take evicted frames, those are for faults.
+            void* page = palloc_get_page(PAL_USER);
+            if (!page) {
+                break;
+            }
+            struct frame* frame = &frames[palloc_user_page_idx(page)];
+            ASSERT(frame->state == FRAME_UNUSED);
+            frame->frame = page;
+            // Not in any pool yet, but no longer free either.
+            frame->state = FRAME_POOLED;
             lock_release(&frame_lock);
-            return NULL;
+
+            memset(page, 0, PGSIZE);
+
+            lock_acquire(&frame_lock);
+            list_push_back(&zero_frames, &frame->free_elem);
+            zero_frame_count++;
         }
+        zeroing_requested = false;
+        lock_release(&frame_lock);
     }
-    new_frame->page = NULL;
-    new_frame->frame = page;
-    list_push_back(&frames, &new_frame->frames_elem);
-    frame_count++;
+}
 
+/* Pins the given frame, so it isn't evicted while the kernel uses
+   it without holding a lock. */
+void
+frame_pin(struct frame* frame) {
+    lock_acquire(&frame_lock);
+    ASSERT(frame->state == FRAME_USED);
+    frame->pin_cnt++;
     lock_release(&frame_lock);
-    return new_frame;
 }
 
-static bool _evict_frame() {
-    ASSERT (lock_held_by_current_thread(&frame_lock));
+/* Unpins the given frame. */
+void
+frame_unpin(struct frame* frame) {
+    lock_acquire(&frame_lock);
+    ASSERT(frame->pin_cnt > 0);
+    frame->pin_cnt--;
+    lock_release(&frame_lock);
+}
 
-    size_t count = 0;
-    size_t length = frame_count;
-    while (count < length + 1) {
-        struct frame* first = list_entry(list_front(&frames), 
-                                         struct frame, frames_elem);
-        struct page* page = first->page;
-        if (page) {
-            struct thread* t = page->thread;
-            if (!pagedir_is_accessed(t->pagedir, page->vaddr)) {
-                // Put the frame in swap and free it.
-                if (page->type != PAGE_MMAP && 
-                        (pagedir_is_dirty(t->pagedir, page->vaddr) ||
-                        pagedir_is_dirty(t->pagedir, first->frame))) {
-                    page->swap_sector = swap_write(first);
-                    page->swapped = true;
-                }
-                _frame_free(first, true); 
-                return true;
+/* Pins the frame of the given page, if it still has one that is not
+   being evicted. Returns whether the frame was pinned. */
+bool
+frame_pin_page(struct page* page) {
+    lock_acquire(&frame_lock);
+    bool pinned = page->frame && !page->evicting;
+    if (pinned) {
+        page->frame->pin_cnt++;
+    }
+    lock_release(&frame_lock);
+    return pinned;
+}
+
+/* Waits until the page-out daemon finished writing the given page
+   to swap, if it is writing it. */
+void
+frame_wait_eviction(struct page* page) {
+    lock_acquire(&frame_lock);
+    while (page->evicting) {
+        cond_wait(&frames_changed, &frame_lock);
+    }
+    lock_release(&frame_lock);
+}
+
+/* Unmaps the private frame of the given page, if it has one, after
+   waiting for any write of the page to swap to finish. The frame is
+   freed unless other pages still share it since fork. */
+void
+frame_free_page(struct page* page) {
+    lock_acquire(&frame_lock);
+    while (page->evicting) {
+        cond_wait(&frames_changed, &frame_lock);
+    }
+    struct frame* frame = page->frame;
+    if (frame) {
+        list_remove(&page->frame_elem);
+        page->frame = NULL;
+        pagedir_clear_page(page->thread->pagedir, page->vaddr);
+        if (list_empty(&frame->pages)) {
+            _frame_free(frame, true);
+        }
+    }
+    lock_release(&frame_lock);
+}
+
+/* Detaches every page of PAGES, the page table of an exiting process,
+   from its frame while holding the frame lock once. Private frames 
+   are freed once no page shares them, page cache frames stay cached.
+   The page table entries are left alone, since the page directory is
+   destroyed right after, which also spares the TLB flushes. */
+void
+frame_release_all(struct hash* pages) {
+    lock_acquire(&frame_lock);
+    struct hash_iterator i;
+    hash_first(&i, pages);
+    while (hash_next(&i)) {
+        struct page* page = hash_entry(hash_cur(&i), struct page, 
+                                       pages_elem);
+        while (page->evicting) {
+            cond_wait(&frames_changed, &frame_lock);
+        }
+        struct frame* frame = page->frame;
+        if (!frame) {
+            continue;
+        }
+        list_remove(&page->frame_elem);
+        page->frame = NULL;
+        if (!frame->cache && list_empty(&frame->pages)) {
+            _frame_free(frame, true);
+        }
+    }
+    lock_release(&frame_lock);
+}
+
+/* Makes the new page PAGE of a forked process share the private data
+   of its parent's page PARENT_PAGE. A resident frame is mapped read
+   only in both processes until one of them writes it, and a page in
+   swap shares its slot. Returns false if out of memory. */
+bool
+frame_fork_page(struct page* parent_page, struct page* page) {
+    ASSERT(!parent_page->cached);
+
+    lock_acquire(&frame_lock);
+    while (parent_page->evicting) {
+        cond_wait(&frames_changed, &frame_lock);
+    }
+    bool success = true;
+    struct frame* frame = parent_page->frame;
+    uint32_t* parent_pd = parent_page->thread->pagedir;
+    if (frame) {
+        uint32_t* pd = page->thread->pagedir;
+        success = pagedir_set_page(pd, page->vaddr, frame->frame, false);
+        if (success) {
+            pagedir_set_writable(parent_pd, parent_page->vaddr, false);
+            // The data may not be stored anywhere else yet, which the
+            // child must still know once the parent stops sharing it.
+            if (pagedir_is_dirty(parent_pd, parent_page->vaddr)) {
+                pagedir_set_dirty(pd, page->vaddr, true);
             }
-            // Reset accessed state.
-            pagedir_set_accessed(t->pagedir, page->vaddr, false);
+            page->frame = frame;
+            list_push_back(&frame->pages, &page->frame_elem);
+        }
+    } else if (parent_page->swapped) {
+        swap_share(parent_page->swap_sector);
+        page->swap_sector = parent_page->swap_sector;
+        page->swapped = true;
+    }
+    lock_release(&frame_lock);
+    return success;
+}
+
+/* Handles a write to the given writable private page, whose frame is
+   mapped read only since it is shared after fork. The page gets a 
+   copy of the frame to itself, or just write access if no other page
+   is left sharing it. Returns false if out of memory. */
+bool
+frame_copy_on_write(struct page* page) {
+    lock_acquire(&frame_lock);
+    struct frame* frame = page->frame;
+    if (!frame) {
+        // Evicted since the fault, faulting again loads it.
+        lock_release(&frame_lock);
+        return true;
+    }
+    uint32_t* pd = page->thread->pagedir;
+    if (list_size(&frame->pages) == 1) {
+        pagedir_set_writable(pd, page->vaddr, true);
+        lock_release(&frame_lock);
+        return true;
+    }
+    // Our page stays in the frame's list, so the pin is all it takes
+    // to keep the frame around while it is copied.
+    frame->pin_cnt++;
+    lock_release(&frame_lock);
+    struct frame* copy = frame_allocate();
+    if (copy) {
+        memcpy(copy->frame, frame->frame, PGSIZE);
+        copy->dirty = true;
+    }
+    lock_acquire(&frame_lock);
+    frame->pin_cnt--;
+    bool success = false;
+    if (copy) {
+        list_remove(&page->frame_elem);
+        pagedir_clear_page(pd, page->vaddr);
+        if (list_empty(&frame->pages)) {
+            _frame_free(frame, true);
+        }
+        success = pagedir_set_page(pd, page->vaddr, copy->frame, true);
+        if (success) {
+            pagedir_set_dirty(pd, page->vaddr, true);
+            page->frame = copy;
+            list_push_back(&copy->pages, &page->frame_elem);
+            copy->pin_cnt--;
+        } else {
+            page->frame = NULL;
+            _frame_free(copy, true);
         }
-        // Push back frame.
-        list_remove(&first->frames_elem);
-        list_push_back(&frames, &first->frames_elem);
-        count++;
     }
-    PANIC("Failed to evict a frame!");
-    return false;
+    lock_release(&frame_lock);
+    return success;
+}
+
+/* Maps the given frame into the given page's list of mappers. */
+void
+frame_add_page(struct frame* frame, struct page* page) {
+    lock_acquire(&frame_lock);
+    list_push_back(&frame->pages, &page->frame_elem);
+    lock_release(&frame_lock);
+}
+
+/* Removes the given page from the mappers of the given frame, and
+   removes the mapping from the page's (real) page table. */
+void
+frame_remove_page(struct frame* frame, struct page* page) {
+    ASSERT(page->frame == frame);
+    lock_acquire(&frame_lock);
+    list_remove(&page->frame_elem);
+    page->frame = NULL;
+    pagedir_clear_page(page->thread->pagedir, page->vaddr);
+    lock_release(&frame_lock);
+}
+
+/* Hands ownership of the given frame to a page cache entry. */
+void
+frame_set_cache(struct frame* frame, struct pagecache_entry* cache) {
+    lock_acquire(&frame_lock);
+    frame->cache = cache;
+    lock_release(&frame_lock);
+}
+
+/* Removes the given frame from every page that maps it. Only valid 
+   while the frame lock is held, i.e. during eviction. */
+void
+frame_unmap(struct frame* frame) {
+    ASSERT(lock_held_by_current_thread(&frame_lock));
+    while (!list_empty(&frame->pages)) {
+        struct page* page = list_entry(list_pop_front(&frame->pages), 
+                                       struct page, frame_elem);
+        page->frame = NULL;
+        // Remove from (real) file table.
+        pagedir_clear_page(page->thread->pagedir, page->vaddr);
+    }
 }
 
 void frame_free(struct frame* frame) {
@@ -114,28 +696,32 @@ _frame_free(struct frame* frame, bool lock_owned) {
     } else {
         ASSERT(lock_held_by_current_thread(&frame_lock));
     }
-    frame_count--;
-    list_remove(&frame->frames_elem);
-    struct page* page = frame->page;
-    if (page) {
-        if (page->type == PAGE_MMAP) {
-            process_mmap_write_to_disk(page);
-        }
-        page->frame = NULL;
-        // Remove from (real) file table.
-        pagedir_clear_page(page->thread->pagedir, page->vaddr);
-    }
+    ASSERT(frame->state == FRAME_USED);
+    frame_unmap(frame);
+    frame->state = FRAME_UNUSED;
+    frame->cache = NULL;
     palloc_free_page(frame->frame);
-    free(frame);
     if (!lock_owned) {
         lock_release(&frame_lock);
     }
 }
 
 void frame_free_all() {
-    while (!list_empty(&frames)) {
-        struct frame* frame = list_entry(list_front(&frames), 
-                                         struct frame, frames_elem);
-        frame_free(frame);
+    for (size_t i = 0; i < frame_count; i++) {
+        if (frames[i].state == FRAME_USED) {
+            frame_free(&frames[i]);
+        }
     }
-}
\ No newline at end of file
+    lock_acquire(&frame_lock);
+    while (!list_empty(&free_frames)) {
+        struct frame* frame = _frame_pop(&free_frames, &free_frame_count);
+        frame->state = FRAME_UNUSED;
+        palloc_free_page(frame->frame);
+    }
+    while (!list_empty(&zero_frames)) {
+        struct frame* frame = _frame_pop(&zero_frames, &zero_frame_count);
+        frame->state = FRAME_UNUSED;
+        palloc_free_page(frame->frame);
+    }
+    lock_release(&frame_lock);
+}
@@ -4,17 +4,48 @@
 #include <list.h>
 #include "vm/page.h"
 
-/* Represents a physical frame. */
+struct pagecache_entry;
+
+/* The state of an entry in the frame table. */
+enum frame_state {
+    FRAME_UNUSED,    /* The page is free in the user pool. */
+    FRAME_POOLED,    /* Evicted, in the free frame pool. */
+    FRAME_USED,      /* Allocated to a page or the page cache. */
+};
+
+/* Represents a physical frame, an entry in the frame table. */
 struct frame {
-    void* frame;        /* The kernel page address for this frame. */
-    struct page* page;  /* The virtual page that is mapped to this frame.*/
+    void* frame;                   /* The kernel page address for this frame. */
+    enum frame_state state;        /* The state of this frame. */
+    int pin_cnt;                   /* >0: in use by the kernel, must not
+                                      be evicted. */
+    struct list pages;             /* The virtual pages mapped to this frame. */
+    struct pagecache_entry* cache; /* The page cache entry owning this frame,
+                                      or NULL if the frame is private. */
+    bool dirty;                    /* Whether the kernel wrote data to it
+                                      that is stored nowhere else. */
 
-    struct list_elem frames_elem; /* The elem for the global frame list. */
+    struct list_elem free_elem;    /* The elem for the free frame pool. */
 };
 
 void frame_init(void);
+void frame_pageout_init(void);
+void frame_idle(void);
+void* frame_zero_page(void);
 struct frame* frame_allocate(void);
 struct frame* frame_allocate_zeros(void);
+void frame_pin(struct frame* frame);
+void frame_unpin(struct frame* frame);
+bool frame_pin_page(struct page* page);
+void frame_add_page(struct frame* frame, struct page* page);
+void frame_remove_page(struct frame* frame, struct page* page);
+void frame_set_cache(struct frame* frame, struct pagecache_entry* cache);
+void frame_unmap(struct frame* frame);
+void frame_wait_eviction(struct page* page);
+void frame_free_page(struct page* page);
+void frame_release_all(struct hash* pages);
+bool frame_fork_page(struct page* parent_page, struct page* page);
+bool frame_copy_on_write(struct page* page);
 void frame_free(struct frame* frame);
 void frame_free_all(void);
 
@@ -6,20 +6,80 @@
 #include "threads/palloc.h"
 #include "lib/string.h"
 #include "vm/swap.h"
+#include "vm/pagecache.h"
+#include <stdio.h>
 
+/* The size of the window of pages mapped on a file page fault. */
+#define FAULT_AROUND_PAGES 8
+/* The pages read ahead of, and deactivated behind, a fault on a page 
+   advised to be accessed sequentially. */
+#define SEQUENTIAL_PAGES 32
+
+/* -vmstats: Print the paging statistics of exiting processes. */
+bool page_exit_stats;
+
+static bool _page_is_anonymous(struct page* page);
+static void _page_map_zero(struct page* page);
+static void _page_fault_around(struct page* page);
+static void _page_drop_behind(struct page* page);
+static bool _page_swap_in(struct page* page);
+static void _page_swap_readahead(block_sector_t sector);
+static bool _page_range_free(void* start, void* end);
+static struct page* _page_create_in_area(struct area* area, void* vaddr);
+static size_t _area_page_length(struct area* area, size_t area_ofs);
+static bool _area_page_cached(struct area* area, void* vaddr);
+static struct page* _page_lookup(void* vaddr);
 static struct page* _page_create(void* vaddr, struct frame* frame, 
                                  bool writable); 
 static bool _page_insert(struct page* page);
-static void _page_set_frame(struct page* page, struct frame* frame);
 static void _page_free(struct page* page, bool delete);
+static void _page_release(struct page* page);
 
 static unsigned page_hash_func(const struct hash_elem *e, void *aux UNUSED);
 static bool page_less_func(const struct hash_elem *_a, 
                           const struct hash_elem *_b, void *aux UNUSED);
+static void page_destroy(struct hash_elem *e, void *aux UNUSED);
                           
 void 
 page_init(struct thread* thread) {
     hash_init(&thread->pages, page_hash_func, page_less_func, NULL);
+    list_init(&thread->areas);
+    memset(&thread->vm_stats, 0, sizeof thread->vm_stats);
+}
+
+/* Fills STAT with the paging statistics of the current process. */
+void
+page_get_stats(struct vmstat* stat) {
+    struct thread* t = thread_current();
+    stat->minor_faults = t->vm_stats.minor_faults;
+    stat->major_faults = t->vm_stats.major_faults;
+    stat->swap_ins = t->vm_stats.swap_ins;
+    stat->swap_outs = t->vm_stats.swap_outs;
+    stat->mmap_writebacks = t->vm_stats.mmap_writebacks;
+    stat->resident_pages = 0;
+    stat->swapped_pages = 0;
+    struct hash_iterator i;
+    hash_first(&i, &t->pages);
+    while (hash_next(&i)) {
+        struct page* page = hash_entry(hash_cur(&i), struct page, pages_elem);
+        if (page->frame) {
+            stat->resident_pages++;
+        } else if (page->swapped) {
+            stat->swapped_pages++;
+        }
+    }
+}
+
+/* Prints the paging statistics of the current process. */
+void
+page_print_stats(void) {
+    struct vmstat stat;
+    page_get_stats(&stat);
+    printf("%s: vm: %u minor faults, %u major faults, %u swap ins, "
+           "%u swap outs, %u mmap writebacks, %u resident, %u swapped\n",
+           thread_current()->name, stat.minor_faults, stat.major_faults, 
+           stat.swap_ins, stat.swap_outs, stat.mmap_writebacks, 
+           stat.resident_pages, stat.swapped_pages);
 }
 
 void* 
@@ -33,35 +93,310 @@ page_create(void* vaddr, bool zeros, bool writable) {
         frame_free(frame);
         return NULL;
     }
+    // The caller writes the page through the returned address.
+    frame->dirty = true;
+    frame_unpin(frame);
     return frame->frame;
 }
 
-struct page* 
-page_create_mmap(void* vaddr, struct file* file, off_t offset, 
-                              size_t length) {
-    struct page* page = page_create_executable(vaddr, file, offset, 
-                                               length, true);
-    if (!page) {
+/* Maps the PAGE_CNT pages at START to the LENGTH bytes at OFFSET in
+   FILE, followed by zeros. No page is created until it is first 
+   faulted on, so mapping is cheap however large the area is. 
+   Returns the new area, or NULL if it would overlap other pages. */
+struct area*
+page_create_area(void* start, size_t page_cnt, page_type type, 
+                 struct file* file, off_t offset, size_t length, 
+                 bool writable) {
+    ASSERT(pg_ofs(start) == 0);
+    ASSERT(type != PAGE_NORMAL);
+
+    void* end = start + page_cnt * PGSIZE;
+    if (page_cnt == 0 || end <= start || !is_user_vaddr(end - 1) || 
+        !_page_range_free(start, end)) {
         return NULL;
     }
-    page->type = PAGE_MMAP;
-    return page;
+    struct area* area = malloc(sizeof(struct area));
+    if (!area) {
+        return NULL;
+    }
+    area->start = start;
+    area->end = end;
+    area->type = type;
+    area->writable = writable;
+    area->file = file;
+    area->offset = offset;
+    area->length = length;
+    area->advice = PAGE_ADVICE_NORMAL;
+    list_push_back(&thread_current()->areas, &area->areas_elem);
+    return area;
+}
+
+/* Frees the given area of the current process, and every page that
+   was created in it. */
+void
+page_free_area(struct area* area) {
+    for (void* vaddr = area->start; vaddr < area->end; vaddr += PGSIZE) {
+        struct page* page = _page_lookup(vaddr);
+        if (page) {
+            page_free(page);
+        }
+    }
+    list_remove(&area->areas_elem);
+    free(area);
+}
+
+/* Sets the expected access pattern of the current process's pages 
+   from START up to END to ADVICE. Areas lying entirely in the range 
+   keep it for pages created later, pages of areas partly in the range
+   are created right away to hold it. */
+void
+page_advise(void* start, void* end, page_advice advice) {
+    struct list* areas = &thread_current()->areas;
+    for (struct list_elem* e = list_begin(areas); e != list_end(areas); 
+         e = list_next(e)) {
+        struct area* area = list_entry(e, struct area, areas_elem);
+        if (start <= area->start && area->end <= end) {
+            area->advice = advice;
+        }
+    }
+    for (void* vaddr = start; vaddr < end; vaddr += PGSIZE) {
+        struct page* page = _page_lookup(vaddr);
+        if (!page) {
+            struct area* area = page_find_area(vaddr);
+            if (!area || area->advice == advice) {
+                continue;
+            }
+            page = _page_create_in_area(area, vaddr);
+            if (!page) {
+                return;
+            }
+        }
+        page->advice = advice;
+    }
+}
+
+/* Loads the current process's pages from START up to END, so the 
+   process takes no faults on them later. Shared pages are read into 
+   the page cache a fault-around window at a time. Stops early if 
+   memory runs out, leaving the rest to be faulted in. */
+void
+page_prefetch(void* start, void* end) {
+    for (void* vaddr = start; vaddr < end; vaddr += PGSIZE) {
+        struct page* page = page_find(vaddr);
+        if (!page) {
+            return;
+        }
+        if (page->frame || page->zero_mapped) {
+            continue;
+        }
+        if (!page_try_load_in_frame(page, false)) {
+            return;
+        }
+    }
+}
+
+/* Drops the data of the current process's pages from START up to END,
+   freeing their frames and swap slots. The pages stay mapped: file 
+   pages are read from their file again on the next access, anonymous
+   pages come back as zeros. */
+void
+page_discard(void* start, void* end) {
+    for (void* vaddr = start; vaddr < end; vaddr += PGSIZE) {
+        struct page* page = _page_lookup(vaddr);
+        if (page) {
+            _page_release(page);
+        }
+    }
 }
 
-struct page* 
-page_create_executable(void* vaddr, struct file* file, 
-        off_t offset, size_t length, bool writable) {
-    struct page* page = _page_create(vaddr, NULL, writable);
+/* Loads the current process's page containing VADDR and pins its 
+   frame, so the kernel can access it while holding locks without 
+   faulting, or the page being evicted. With WRITE, the page gets a 
+   frame of its own first if it shares one copy-on-write. Returns 
+   false if there is no such page, or it is read only for WRITE, or 
+   memory ran out. */
+bool
+page_pin(void* vaddr, bool write) {
+    struct page* page = page_find(vaddr);
+    if (!page || (write && !page->writable)) {
+        return false;
+    }
+    for (;;) {
+        if (!page->frame && !page->zero_mapped) {
+            page_try_load_in_frame(page, write);
+            if (!page->frame && !page->zero_mapped) {
+                return false;
+            }
+        }
+        if (write && !page->cached && !page_copy_on_write(page)) {
+            return false;
+        }
+        // The zero page is never evicted, and only our own writes 
+        // replace it.
+        if (page->zero_mapped || frame_pin_page(page)) {
+            return true;
+        }
+        // Evicted in the meantime, so load it again.
+    }
+}
+
+/* Unpins the current process's page containing VADDR, pinned by
+   page_pin. */
+void
+page_unpin(void* vaddr) {
+    struct page* page = _page_lookup(pg_round_down(vaddr));
+    ASSERT(page);
+    if (page->frame) {
+        frame_unpin(page->frame);
+    }
+}
+
+/* Pins every page of the SIZE bytes at START using page_pin. Returns
+   false, with no page pinned, if any page can't be pinned. */
+bool
+page_pin_range(void* start, size_t size, bool write) {
+    if (size == 0) {
+        return true;
+    }
+    void* first = pg_round_down(start);
+    void* end = start + size;
+    for (void* vaddr = first; vaddr < end; vaddr += PGSIZE) {
+        if (!page_pin(vaddr, write)) {
+            page_unpin_range(first, vaddr - first);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Unpins every page of the SIZE bytes at START, pinned by 
+   page_pin_range. */
+void
+page_unpin_range(void* start, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    void* end = start + size;
+    for (void* vaddr = pg_round_down(start); vaddr < end; vaddr += PGSIZE) {
+        page_unpin(vaddr);
+    }
+}
+
+/* Returns the area of the current process containing VADDR, or NULL 
+   if there is none. */
+struct area*
+page_find_area(void* vaddr) {
+    struct list* areas = &thread_current()->areas;
+    for (struct list_elem* e = list_begin(areas); e != list_end(areas); 
+         e = list_next(e)) {
+        struct area* area = list_entry(e, struct area, areas_elem);
+        if (area->start <= vaddr && vaddr < area->end) {
+            return area;
+        }
+    }
+    return NULL;
+}
+
+/* Frees every page of the current, exiting process. Its frames and
+   swap slots are released in bulk, taking each lock once, and the 
+   page table entries are left for pagedir_destroy to throw away. */
+void
+page_destroy_all(void) {
+    struct hash* pages = &thread_current()->pages;
+    // Also waits for the page-out daemon to finish with our pages, so
+    // their swap slots are known.
+    pagecache_release_all(pages);
+    swap_free_all(pages);
+    hash_destroy(pages, page_destroy);
+}
+
+/* Frees the areas left over once the current process's pages are 
+   destroyed. */
+void
+page_destroy_areas(void) {
+    struct list* areas = &thread_current()->areas;
+    while (!list_empty(areas)) {
+        free(list_entry(list_pop_front(areas), struct area, areas_elem));
+    }
+}
+
+/* Returns whether no page or area of the current process lies in the
+   range from START up to END. */
+static bool
+_page_range_free(void* start, void* end) {
+    struct thread* t = thread_current();
+    for (struct list_elem* e = list_begin(&t->areas); 
+         e != list_end(&t->areas); e = list_next(e)) {
+        struct area* area = list_entry(e, struct area, areas_elem);
+        if (area->start < end && start < area->end) {
+            return false;
+        }
+    }
+    // Look at whichever is fewer, the pages in the range or the pages
+    // that were created.
+    if ((size_t) (end - start) / PGSIZE <= hash_size(&t->pages)) {
+        for (void* vaddr = start; vaddr < end; vaddr += PGSIZE) {
+            if (_page_lookup(vaddr)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    struct hash_iterator i;
+    hash_first(&i, &t->pages);
+    while (hash_next(&i)) {
+        struct page* page = hash_entry(hash_cur(&i), struct page, pages_elem);
+        if (start <= page->vaddr && page->vaddr < end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Creates the page at VADDR in the given area, on its first fault. */
+static struct page*
+_page_create_in_area(struct area* area, void* vaddr) {
+    struct page* page = _page_create(vaddr, NULL, area->writable);
     if (!page) {
         return NULL;
     }
-    page->type = PAGE_EXECUTABLE;
-    page->file = file;
-    page->offset = offset;
-    page->length = length;
+    size_t area_ofs = page->vaddr - area->start;
+    page->type = area->type;
+    page->file = area->file;
+    page->offset = area->offset + area_ofs;
+    page->advice = area->advice;
+    page->length = _area_page_length(area, area_ofs);
+    page->cached = _area_page_cached(area, page->vaddr);
     return page;
 }
 
+/* Returns the bytes of the file in the page at AREA_OFS in the given
+   area, the rest of the page is zeros. */
+static size_t
+_area_page_length(struct area* area, size_t area_ofs) {
+    if (area->length <= area_ofs) {
+        return 0;
+    }
+    return area->length - area_ofs < PGSIZE ? area->length - area_ofs 
+                                            : PGSIZE;
+}
+
+/* Returns whether the page at VADDR in the given area maps the page
+   cache's frame of its file data, instead of a private frame. */
+static bool
+_area_page_cached(struct area* area, void* vaddr) {
+    if (area->type == PAGE_MMAP) {
+        return true;
+    }
+    // Read-only pages can share the page cache's frame, as long as 
+    // the cached page holds exactly the bytes this page would load.
+    size_t area_ofs = vaddr - area->start;
+    size_t length = _area_page_length(area, area_ofs);
+    return !area->writable && (length == PGSIZE || 
+           area->offset + (off_t) (area_ofs + length) >= 
+           file_length(area->file));
+}
+
 static struct page* 
 _page_create(void* vaddr, struct frame* frame, 
                                  bool writable) {
@@ -73,9 +408,13 @@ _page_create(void* vaddr, struct frame* frame,
     page->thread = thread_current();
     page->writable = writable;
     page->type = PAGE_NORMAL;
+    page->cached = false;
     page->file = NULL;
     page->offset = 0;
     page->swapped = false;
+    page->evicting = false;
+    page->zero_mapped = false;
+    page->advice = PAGE_ADVICE_NORMAL;
     // Magics for debug.
     page->swap_sector = 69;
     page->length = 69;
@@ -83,7 +422,7 @@ _page_create(void* vaddr, struct frame* frame,
         free(page);
         return NULL;
     }
-    _page_set_frame(page, frame);
+    page_set_frame(page, frame);
     return page;
 }
 
@@ -105,23 +444,162 @@ page_free(struct page* page) {
 
 static void 
 _page_free(struct page* page, bool delete) {
+    _page_release(page);
+    if (delete) {
+        hash_delete(&page->thread->pages, &page->pages_elem);
+    }
+    free(page);
+}
+
+/* Unmaps the given page and frees its frame and swap slot, leaving 
+   the page to be loaded from scratch on its next fault. */
+static void
+_page_release(struct page* page) {
+    // The zero page must not be freed with the page directory.
+    if (page->zero_mapped) {
+        pagedir_clear_page(page->thread->pagedir, page->vaddr);
+        page->zero_mapped = false;
+    }
+    if (page->cached) {
+        pagecache_release(page);
+    } else {
+        // Also waits for the page-out daemon to finish with the page.
+        frame_free_page(page);
+    }
     if (page->swapped) {
         swap_free(page->swap_sector);
+        page->swapped = false;
     }
-    if (page->frame) {
-        frame_free(page->frame);
+}
+
+/* Copies the supplemental page table of the given parent process
+   into the current, newly forked process. Private data is shared 
+   copy-on-write, and pages of files point to the parent's files until
+   the caller replaces them. Returns false if out of memory. */
+bool
+page_fork(struct thread* parent) {
+    struct list* areas = &thread_current()->areas;
+    for (struct list_elem* e = list_begin(&parent->areas); 
+         e != list_end(&parent->areas); e = list_next(e)) {
+        struct area* area = malloc(sizeof(struct area));
+        if (!area) {
+            return false;
+        }
+        *area = *list_entry(e, struct area, areas_elem);
+        list_push_back(areas, &area->areas_elem);
     }
-    if (delete) {
-        hash_delete(&page->thread->pages, &page->pages_elem);
+
+    struct hash_iterator i;
+    hash_first(&i, &parent->pages);
+    while (hash_next(&i)) {
+        struct page* parent_page = hash_entry(hash_cur(&i), struct page, 
+                                              pages_elem);
+        struct page* page = _page_create(parent_page->vaddr, NULL, 
+                                         parent_page->writable);
+        if (!page) {
+            return false;
+        }
+        page->type = parent_page->type;
+        page->cached = parent_page->cached;
+        page->file = parent_page->file;
+        page->offset = parent_page->offset;
+        page->length = parent_page->length;
+        page->advice = parent_page->advice;
+        // Cached pages just fault in the page cache's frame again.
+        if (!page->cached && !frame_fork_page(parent_page, page)) {
+            return false;
+        }
     }
-    free(page);
+    return true;
+}
+
+/* Points every page and area of the current process loading from
+   file OLD to load from file NEW instead. */
+void
+page_replace_file(struct file* old, struct file* new) {
+    struct hash_iterator i;
+    hash_first(&i, &thread_current()->pages);
+    while (hash_next(&i)) {
+        struct page* page = hash_entry(hash_cur(&i), struct page, pages_elem);
+        if (page->file == old) {
+            page->file = new;
+        }
+    }
+    struct list* areas = &thread_current()->areas;
+    for (struct list_elem* e = list_begin(areas); e != list_end(areas); 
+         e = list_next(e)) {
+        struct area* area = list_entry(e, struct area, areas_elem);
+        if (area->file == old) {
+            area->file = new;
+        }
+    }
+}
+
+/* Handles a write fault on the given page, which is present but
+   mapped read only. Returns true if the page is writable and was 
+   only read only since its frame is shared after fork, or it maps
+   the shared zero page. */
+bool
+page_copy_on_write(struct page* page) {
+    if (!page->writable || page->cached) {
+        return false;
+    }
+    if (page->zero_mapped) {
+        struct frame* frame = frame_allocate_zeros();
+        if (!frame) {
+            return false;
+        }
+        pagedir_clear_page(page->thread->pagedir, page->vaddr);
+        page->zero_mapped = false;
+        page_set_frame(page, frame);
+        frame_unpin(frame);
+        return true;
+    }
+    return frame_copy_on_write(page);
 }
 
+/* Returns the current process's page containing VADDR, creating it 
+   if VADDR lies in an area but wasn't faulted on before. Returns 
+   NULL if there is no such page. */
 struct 
 page* page_find(void* vaddr) {
     void* page_vaddr = pg_round_down(vaddr);
+    struct page* page = _page_lookup(page_vaddr);
+    if (page) {
+        return page;
+    }
+    struct area* area = page_find_area(page_vaddr);
+    if (!area) {
+        return NULL;
+    }
+    return _page_create_in_area(area, page_vaddr);
+}
+
+/* Returns whether the current process has a page containing VADDR,
+   storing whether it is writable in *WRITABLE. Unlike page_find, 
+   pages of areas that weren't faulted on yet aren't created. */
+bool
+page_exists(void* vaddr, bool* writable) {
+    void* page_vaddr = pg_round_down(vaddr);
+    struct page* page = _page_lookup(page_vaddr);
+    if (page) {
+        *writable = page->writable;
+        return true;
+    }
+    struct area* area = page_find_area(page_vaddr);
+    if (area) {
+        *writable = area->writable;
+        return true;
+    }
+    return false;
+}
+
+/* Returns the current process's page at the page aligned VADDR, 
+   only if it was already created. */
+static struct page*
+_page_lookup(void* vaddr) {
     struct page find_page;
-    find_page.vaddr = page_vaddr;
+    find_page.vaddr = vaddr;
 
     struct thread* t = thread_current();
     struct hash_elem* page = hash_find(&t->pages, &find_page.pages_elem);
@@ -131,56 +609,212 @@ page* page_find(void* vaddr) {
     return hash_entry(page, struct page, pages_elem);
 }
 
+/* Loads the given page's data into a frame and maps it, for a fault
+   on the page that is a WRITE or a read. Untouched anonymous pages
+   are mapped to the shared zero page on reads instead. */
 bool 
-page_try_load_in_frame(struct page* page) {
+page_try_load_in_frame(struct page* page, bool write) {
+    // The page-out daemon may still be writing the page to swap.
+    frame_wait_eviction(page);
     // If page already has a frame, there's no loading to be done.
     if (page->frame) {
         return false;
     }
+    struct vm_stats* stats = &page->thread->vm_stats;
     if (page->swapped) {
-        struct frame* frame = swap_read(page->swap_sector);
-        if (!frame) {
+        block_sector_t sector = page->swap_sector;
+        if (!_page_swap_in(page)) {
+            return false;
+        }
+        stats->major_faults++;
+        if (page->advice != PAGE_ADVICE_RANDOM) {
+            _page_swap_readahead(sector);
+        }
+        _page_drop_behind(page);
+        return true;
+    }
+    if (page->cached) {
+        if (!pagecache_load(page, false)) {
             return false;
         }
-        // Data that is swapped in is considered dirty.
-        pagedir_set_dirty(page->thread->pagedir, page->vaddr, true);
-        _page_set_frame(page, frame);
+        if (page->advice != PAGE_ADVICE_RANDOM) {
+            _page_fault_around(page);
+        }
+        _page_drop_behind(page);
+        return true;
+    }
+    if (_page_is_anonymous(page) && !write) {
+        _page_map_zero(page);
+        stats->minor_faults++;
         return true;
     }
     
-    struct frame* frame = frame_allocate();
+    struct frame* frame = _page_is_anonymous(page) ? frame_allocate_zeros()
+                                                   : frame_allocate();
     if (!frame) {
         return false;
     }
-    if (page->type == PAGE_MMAP || page->type == PAGE_EXECUTABLE) {
+    bool read = false;
+    if (page->type != PAGE_NORMAL) {
         size_t length = page->length;
         if (length > 0) {
             struct file* file = page->file;
             file_read_at(file, frame->frame, length, page->offset);
+            read = true;
         }
         if (length < PGSIZE) {
             memset(frame->frame + length, 0, PGSIZE - length);
         }
     }
-    _page_set_frame(page, frame);
+    if (read) {
+        stats->major_faults++;
+    } else {
+        stats->minor_faults++;
+    }
+    page_set_frame(page, frame);
+    frame_unpin(frame);
+    _page_drop_behind(page);
     return true;
 }
 
+/* Returns whether the given page holds nothing but zeros until it is
+   first written, either anonymous memory or a page of BSS. */
+static bool
+_page_is_anonymous(struct page* page) {
+    return !page->cached && !page->swapped && 
+           (page->type == PAGE_NORMAL || 
+            (page->type != PAGE_MMAP && page->length == 0));
+}
+
+/* Maps the shared zero page read only at the given page, which then 
+   gets a frame of its own on its first write. */
+static void
+_page_map_zero(struct page* page) {
+    ASSERT(!page->frame);
+    pagedir_set_page(page->thread->pagedir, page->vaddr, frame_zero_page(),
+                     false);
+    page->zero_mapped = true;
+}
+
+/* Maps the pages of the same file in the aligned window of 
+   FAULT_AROUND_PAGES pages around the given page, which was just
+   faulted in, so programs touching their text or mapped files page 
+   by page take one fault per window instead of one per page. Pages
+   advised to be accessed sequentially map the SEQUENTIAL_PAGES pages 
+   starting at the page instead. */
+static void
+_page_fault_around(struct page* page) {
+    uintptr_t window = FAULT_AROUND_PAGES * PGSIZE;
+    uint8_t* start = (uint8_t*) ((uintptr_t) page->vaddr & ~(window - 1));
+    size_t page_cnt = FAULT_AROUND_PAGES;
+    if (page->advice == PAGE_ADVICE_SEQUENTIAL) {
+        start = page->vaddr;
+        page_cnt = SEQUENTIAL_PAGES;
+    }
+    for (size_t i = 0; i < page_cnt; i++) {
+        void* vaddr = start + i * PGSIZE;
+        if (vaddr == page->vaddr || !is_user_vaddr(vaddr)) {
+            continue;
+        }
+        struct page* neighbour = _page_lookup(vaddr);
+        if (!neighbour) {
+            // Only create the pages that are mapped right away.
+            struct area* area = page_find_area(vaddr);
+            if (!area || area->file != page->file || 
+                !_area_page_cached(area, vaddr)) {
+                continue;
+            }
+            neighbour = _page_create_in_area(area, vaddr);
+            if (!neighbour) {
+                break;
+            }
+        }
+        if (!neighbour->cached || neighbour->frame ||
+            neighbour->file != page->file) {
+            continue;
+        }
+        // Pages the process never touches are evicted first, since
+        // their accessed bits stay clear.
+        if (!pagecache_load(neighbour, true)) {
+            break;
+        }
+    }
+}
+
+/* Clears the accessed bits of the resident pages in the 
+   SEQUENTIAL_PAGES pages behind the given page, which was just 
+   faulted in, if it is accessed sequentially. A program streaming 
+   through its data won't go back, so the clock takes those frames 
+   before the rest of its working set. */
+static void
+_page_drop_behind(struct page* page) {
+    if (page->advice != PAGE_ADVICE_SEQUENTIAL) {
+        return;
+    }
+    uint32_t* pd = page->thread->pagedir;
+    for (size_t i = 1; i <= SEQUENTIAL_PAGES; i++) {
+        uint8_t* vaddr = (uint8_t*) page->vaddr - i * PGSIZE;
+        if (vaddr >= (uint8_t*) page->vaddr) {
+            break;
+        }
+        struct page* behind = _page_lookup(vaddr);
+        if (behind && behind->frame) {
+            pagedir_set_accessed(pd, vaddr, false);
+        }
+    }
+}
+
+/* Reads the given page back from swap into a new frame. */
+static bool
+_page_swap_in(struct page* page) {
+    struct frame* frame = swap_read(page->swap_sector);
+    if (!frame) {
+        return false;
+    }
+    page->thread->vm_stats.swap_ins++;
+    page_set_frame(page, frame);
+    // Data that is swapped in is considered dirty, which mapping the
+    // frame would reset.
+    pagedir_set_dirty(page->thread->pagedir, page->vaddr, true);
+    frame_unpin(frame);
+    return true;
+}
+
+/* Speculatively swaps in the current process's pages stored in the
+   slots after the given one, which were likely evicted together with
+   the page just faulted in and will be needed soon. */
+static void
+_page_swap_readahead(block_sector_t sector) {
+    for (int i = 1; i < SWAP_CLUSTER; i++) {
+        struct page* page = swap_neighbour(sector, i);
+        if (!page) {
+            break;
+        }
+        // Only the page-out daemon changes our pages behind our back,
+        // and it is done with a page once it is swapped and unmapped.
+        frame_wait_eviction(page);
+        if (!page->swapped || page->frame || !_page_swap_in(page)) {
+            break;
+        }
+        // Let the clock reclaim the page if it is never used.
+        pagedir_set_accessed(page->thread->pagedir, page->vaddr, false);
+    }
+}
+
 /* Assigns the given frame to the given page, and mapping from virtual 
-   page to frame is created. The page is set to be out of swap memory, 
-   and the frame to unlocked state.
+   page to frame is created. The page is set to be out of swap memory.
 
-   NOTE: This means after this call, the frame may be instantly 
-   de-allocated. */
-static void 
-_page_set_frame(struct page* page, struct frame* frame) {
+   NOTE: Once the caller unpins the frame, it may be instantly 
+   evicted. */
+void 
+page_set_frame(struct page* page, struct frame* frame) {
     page->frame = frame;
     if (frame) {
         page->swapped = false;
         // Add the mapping from virtual page to kernel page.
         pagedir_set_page(page->thread->pagedir, page->vaddr, 
                          frame->frame, page->writable);
-        frame->page = page; // Allows the frame to de-allocated.
+        frame_add_page(frame, page);
     }
 }
 
@@ -198,8 +832,8 @@ page_less_func(const struct hash_elem *_a, const struct hash_elem *_b,
   return a->vaddr < b->vaddr;
 }
 
-void 
+static void 
 page_destroy(struct hash_elem *e, void *aux UNUSED) {
     struct page *page = hash_entry(e, struct page, pages_elem);
-    _page_free(page, false);
+    free(page);
 }
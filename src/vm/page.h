@@ -7,20 +7,32 @@
 #include "threads/thread.h"
 #include "filesys/file.h"
 #include "devices/block.h"
+#include "lib/user/syscall.h"
 
 /* The type of data that this page represents. */
 typedef enum page_type {
-    PAGE_NORMAL,      /* Misc user page type. */
-    PAGE_MMAP,        /* Memory mapped file page type. */
-    PAGE_EXECUTABLE,  /* Executable file page type. */
+    PAGE_NORMAL,        /* Misc user page type. */
+    PAGE_MMAP,          /* Memory mapped file page type. */
+    PAGE_EXECUTABLE,    /* Executable file page type. */
+    PAGE_MMAP_PRIVATE,  /* Privately mapped file page type. */
 } page_type;
 
+/* How the process said it will access a range of pages. */
+typedef enum page_advice {
+    PAGE_ADVICE_NORMAL,     /* No particular pattern. */
+    PAGE_ADVICE_RANDOM,     /* Random accesses, don't read ahead. */
+    PAGE_ADVICE_SEQUENTIAL, /* Sequential accesses, read ahead far and
+                               evict pages behind early. */
+} page_advice;
+
 /* Represents a page in virtual user memory. */
 struct page {
     void* vaddr;                 /* The virtual address of this page. */
     struct frame* frame;         /* The frame that this page is loaded into. */
     bool writable;               /* Whether this page is writable. */
     page_type type;              /* The type of data for this page. */
+    bool cached;                 /* Whether the frame is shared through 
+                                    the page cache. */
     struct thread* thread;       /* The owning thread of this page. */
 
     // Mmap / Executable Pages
@@ -31,19 +43,59 @@ struct page {
     // Swapped Pages
     bool swapped;                /* Whether this page's frame is in swap. */
     block_sector_t swap_sector;  /* The swap sector the frame is stored in. */
+    bool evicting;               /* Whether it is being written to swap. */
+    bool zero_mapped;            /* Whether the shared zero page is mapped
+                                    until the first write. */
+    page_advice advice;          /* The expected access pattern. */
 
     struct hash_elem pages_elem; /* The hash elem for thread pages list. */
+    struct list_elem frame_elem; /* The list elem for the frame's pages. */
 };
 
+/* A range of virtual user memory mapping a file, whose pages are 
+   only created when they are first faulted on. */
+struct area {
+    void* start;                  /* The first page of the area. */
+    void* end;                    /* The page after the area. */
+    page_type type;               /* The type of the area's pages. */
+    bool writable;                /* Whether the area is writable. */
+    struct file* file;            /* The file that the area maps. */
+    off_t offset;                 /* The offset of the area in the file. */
+    size_t length;                /* The bytes of the file in the area, the
+                                     rest of the area is zeros. */
+    page_advice advice;           /* The access pattern of new pages. */
+
+    struct list_elem areas_elem;  /* The list elem for thread areas list. */
+};
+
+/* Whether exiting processes print their paging statistics. */
+extern bool page_exit_stats;
+
 void page_init(struct thread* thread); 
+void page_get_stats(struct vmstat* stat);
+void page_print_stats(void);
 void* page_create(void* vaddr, bool zeros, bool writable);
-struct page* page_create_mmap(void* vaddr, struct file* file, off_t offset, 
-                              size_t length);
-struct page* page_create_executable(void* vaddr, struct file* file, 
-        off_t offset, size_t length, bool writable);
+struct area* page_create_area(void* start, size_t page_cnt, page_type type,
+                              struct file* file, off_t offset, size_t length,
+                              bool writable);
+void page_free_area(struct area* area);
+void page_advise(void* start, void* end, page_advice advice);
+void page_prefetch(void* start, void* end);
+void page_discard(void* start, void* end);
+bool page_pin(void* vaddr, bool write);
+void page_unpin(void* vaddr);
+bool page_pin_range(void* start, size_t size, bool write);
+void page_unpin_range(void* start, size_t size);
+struct area* page_find_area(void* vaddr);
+void page_destroy_all(void);
+void page_destroy_areas(void);
 struct page* page_find(void* vaddr);
-bool page_try_load_in_frame(struct page* page);
+bool page_exists(void* vaddr, bool* writable);
+bool page_fork(struct thread* parent);
+void page_replace_file(struct file* old, struct file* new);
+bool page_copy_on_write(struct page* page);
+bool page_try_load_in_frame(struct page* page, bool write);
+void page_set_frame(struct page* page, struct frame* frame);
 void page_free(struct page* page);
-void page_destroy(struct hash_elem *e, void *aux UNUSED);
 
 #endif /* vm/page.h */
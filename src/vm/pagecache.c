@@ -0,0 +1,768 @@
+#include "vm/pagecache.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "filesys/file.h"
+
+/* The page cache, keyed by (inode, page offset). */
+static struct hash cache;
+
+/* The entries of the page cache caching one inode, so syncing or 
+   dropping an inode doesn't have to look at the whole cache. */
+struct pagecache_file {
+    struct inode* inode;         /* The cached inode. */
+    struct list entries;         /* Its entries, in no particular order. */
+
+    struct hash_elem files_elem; /* The hash elem for the cached files. */
+};
+/* The inodes with pages in the page cache, keyed by inode. */
+static struct hash files;
+
+/* Aquired whenever the page cache or one of its entries is accessed.
+   May be aquired before the frame lock, but never after it. Never 
+   held while reading or writing a file, since the file system takes
+   its own locks that are held while updating the page cache. */
+static struct lock pagecache_lock;
+/* Broadcast whenever an entry finished being loaded or written back. */
+static struct condition pagecache_io;
+
+/* Dirty mmap pages are written back every WRITEBACK_TICKS timer 
+   ticks, at most WRITEBACK_BATCH pages at a time. */
+#define WRITEBACK_TICKS 500
+#define WRITEBACK_BATCH 8
+/* Timer ticks since the writeback thread was last woken up. */
+static unsigned writeback_ticks;
+/* Whether the writeback thread runs, and was woken up. */
+static bool writeback_started;
+static bool writeback_requested;
+/* Upped to wake up the writeback thread. */
+static struct semaphore writeback_sema;
+
+static struct pagecache_file* _pagecache_find_file(struct inode* inode);
+static struct pagecache_entry* _pagecache_find(struct inode* inode,
+                                               off_t offset);
+static struct pagecache_entry* _pagecache_find_loaded(struct inode* inode,
+                                                      off_t offset);
+static struct pagecache_entry* _pagecache_insert(struct inode* inode,
+                                                 off_t offset,
+                                                 struct frame* frame);
+static void _pagecache_read_in(struct pagecache_entry* entry);
+static void _pagecache_start_write(struct pagecache_entry* entry);
+static void _pagecache_write_list(struct list* entries);
+static void _pagecache_write_back(struct pagecache_entry* entry);
+static void _pagecache_end_io(struct pagecache_entry* entry);
+static void _pagecache_remove(struct pagecache_entry* entry);
+static bool _pagecache_collect_dirty(struct pagecache_entry* entry);
+static bool _pagecache_queue_dirty(struct pagecache_entry* entry, 
+                                   struct list* batch, bool* busy);
+static void writeback_thread(void* aux UNUSED);
+
+static unsigned pagecache_hash_func(const struct hash_elem *e,
+                                    void *aux UNUSED);
+static bool pagecache_less_func(const struct hash_elem *_a,
+                                const struct hash_elem *_b, void *aux UNUSED);
+static unsigned file_hash_func(const struct hash_elem *e, void *aux UNUSED);
+static bool file_less_func(const struct hash_elem *_a,
+                           const struct hash_elem *_b, void *aux UNUSED);
+
+void
+pagecache_init() {
+    hash_init(&cache, pagecache_hash_func, pagecache_less_func, NULL);
+    hash_init(&files, file_hash_func, file_less_func, NULL);
+    lock_init(&pagecache_lock);
+    cond_init(&pagecache_io);
+    sema_init(&writeback_sema, 0);
+}
+
+/* Starts the writeback thread, once the file system is available. */
+void
+pagecache_writeback_init() {
+    thread_create("writeback", PRI_DEFAULT, writeback_thread, NULL);
+    writeback_started = true;
+}
+
+/* Called by the timer interrupt on every tick, to wake up the 
+   writeback thread periodically. */
+void
+pagecache_tick() {
+    if (++writeback_ticks >= WRITEBACK_TICKS && writeback_started &&
+        !writeback_requested) {
+        writeback_ticks = 0;
+        writeback_requested = true;
+        sema_up(&writeback_sema);
+    }
+}
+
+
+/* Writes back the dirty pages of the given inode, or of every inode 
+   if it is NULL, in batches of WRITEBACK_BATCH pages, letting faults
+   get at the page cache in between. The pages of a given inode that
+   another thread is writing back are waited for, since they may have
+   been written again in the meantime. */
+void
+pagecache_sync(struct inode* inode) {
+    lock_acquire(&pagecache_lock);
+    for (;;) {
+        struct list batch;
+        list_init(&batch);
+        size_t batch_cnt = 0;
+        bool busy = false;
+        if (inode) {
+            // Only the inode's own pages are looked at.
+            struct pagecache_file* file = _pagecache_find_file(inode);
+            struct list_elem* e = file ? list_begin(&file->entries) : NULL;
+            for (; file && e != list_end(&file->entries) && 
+                 batch_cnt < WRITEBACK_BATCH; e = list_next(e)) {
+                struct pagecache_entry* entry = list_entry(
+                    e, struct pagecache_entry, file_elem);
+                batch_cnt += _pagecache_queue_dirty(entry, &batch, &busy);
+            }
+        } else {
+            struct hash_iterator i;
+            hash_first(&i, &cache);
+            while (batch_cnt < WRITEBACK_BATCH && hash_next(&i)) {
+                struct pagecache_entry* entry = hash_entry(
+                    hash_cur(&i), struct pagecache_entry, cache_elem);
+                batch_cnt += _pagecache_queue_dirty(entry, &batch, &busy);
+            }
+        }
+        // Written pages are clean now, so the next scan moves on.
+        _pagecache_write_list(&batch);
+        if (batch_cnt == WRITEBACK_BATCH) {
+            lock_release(&pagecache_lock);
+            thread_yield();
+            lock_acquire(&pagecache_lock);
+        } else if (inode && busy) {
+            cond_wait(&pagecache_io, &pagecache_lock);
+        } else {
+            break;
+        }
+    }
+    lock_release(&pagecache_lock);
+}
+
+/* Starts writing back ENTRY, adding it to BATCH, if it is dirty and 
+   no other thread is loading or writing it back. Sets *BUSY if 
+   another thread is writing it back. Returns whether it was added. */
+static bool
+_pagecache_queue_dirty(struct pagecache_entry* entry, struct list* batch,
+                       bool* busy) {
+    if (entry->io_thread) {
+        *busy = *busy || entry->loaded;
+        return false;
+    }
+    if (!_pagecache_collect_dirty(entry)) {
+        return false;
+    }
+    _pagecache_start_write(entry);
+    list_push_back(batch, &entry->io_elem);
+    return true;
+}
+
+/* Moves the dirty bits of every mapper of the given entry into the 
+   entry, clearing them so later writes are noticed again. Returns
+   whether the entry is dirty. */
+static bool
+_pagecache_collect_dirty(struct pagecache_entry* entry) {
+    ASSERT(lock_held_by_current_thread(&pagecache_lock));
+
+    // Mappers are only added and removed while holding the page cache.
+    struct frame* frame = entry->frame;
+    for (struct list_elem* e = list_begin(&frame->pages);
+         e != list_end(&frame->pages); e = list_next(e)) {
+        struct page* page = list_entry(e, struct page, frame_elem);
+        uint32_t* pd = page->thread->pagedir;
+        if (pagedir_is_dirty(pd, page->vaddr)) {
+            entry->dirty = true;
+            pagedir_set_dirty(pd, page->vaddr, false);
+            // Counted for the writer, as the entry is written next.
+            // Like every update of mmap_writebacks, this holds the
+            // page cache, which keeps the mapper from exiting.
+            page->thread->vm_stats.mmap_writebacks++;
+        }
+    }
+    return entry->dirty;
+}
+
+/* Periodically writes back pages written through memory mappings, so
+   evicting and unmapping them rarely has to write. */
+static void
+writeback_thread(void* aux UNUSED) {
+    for (;;) {
+        sema_down(&writeback_sema);
+        pagecache_sync(NULL);
+        writeback_requested = false;
+    }
+}
+
+/* Maps the given page to the page cache's frame for its file data,
+   reading the data into a new frame if it isn't cached yet. A 
+   SPECULATIVE load, of a page that wasn't faulted on, doesn't count
+   as a use of the cached page. Returns true if successful. */
+bool
+pagecache_load(struct page* page, bool speculative) {
+    ASSERT(page->cached);
+    ASSERT(page->offset % PGSIZE == 0);
+
+    struct inode* inode = file_get_inode(page->file);
+    lock_acquire(&pagecache_lock);
+    struct pagecache_entry* entry = _pagecache_find_loaded(inode, 
+                                                           page->offset);
+    bool read = false;
+    if (!entry) {
+        // Don't hold the page cache while evicting for a new frame.
+        lock_release(&pagecache_lock);
+        struct frame* frame = frame_allocate();
+        if (!frame) {
+            return false;
+        }
+        lock_acquire(&pagecache_lock);
+        // Someone else may have loaded the page in the meantime.
+        entry = _pagecache_find_loaded(inode, page->offset);
+        if (entry) {
+            frame_free(frame);
+        } else {
+            entry = _pagecache_insert(inode, page->offset, frame);
+            if (!entry) {
+                frame_free(frame);
+                lock_release(&pagecache_lock);
+                return false;
+            }
+            // Others finding the entry wait for the data meanwhile.
+            lock_release(&pagecache_lock);
+            _pagecache_read_in(entry);
+            lock_acquire(&pagecache_lock);
+            _pagecache_end_io(entry);
+            read = true;
+        }
+    }
+    if (!speculative) {
+        entry->referenced = true;
+        if (read) {
+            page->thread->vm_stats.major_faults++;
+        } else {
+            page->thread->vm_stats.minor_faults++;
+        }
+    }
+    page_set_frame(page, entry->frame);
+    lock_release(&pagecache_lock);
+    return true;
+}
+
+/* Unmaps the given page from its page cache frame, if it has one.
+   Data written through memory mapped pages is written back to the
+   file. The frame stays in the cache for other mappers and reads. */
+void
+pagecache_release(struct page* page) {
+    ASSERT(page->cached);
+
+    lock_acquire(&pagecache_lock);
+    struct frame* frame = page->frame;
+    if (frame) {
+        struct pagecache_entry* entry = frame->cache;
+        if (pagedir_is_dirty(page->thread->pagedir, page->vaddr)) {
+            entry->dirty = true;
+        }
+        frame_remove_page(frame, page);
+        if (entry->dirty && page->type == PAGE_MMAP) {
+            struct inode* inode = entry->inode;
+            while (entry && entry->io_thread) {
+                cond_wait(&pagecache_io, &pagecache_lock);
+                entry = _pagecache_find(inode, page->offset);
+            }
+            // Someone else may have written it back meanwhile.
+            if (entry && entry->dirty) {
+                struct list written;
+                list_init(&written);
+                _pagecache_start_write(entry);
+                list_push_back(&written, &entry->io_elem);
+                page->thread->vm_stats.mmap_writebacks++;
+                _pagecache_write_list(&written);
+            }
+        }
+    }
+    lock_release(&pagecache_lock);
+}
+
+/* Detaches every page of PAGES, the page table of an exiting process,
+   from its frame while holding the page cache once, writing back data
+   written through memory mapped pages. Private frames are freed 
+   unless shared, cached frames stay in the cache. */
+void
+pagecache_release_all(struct hash* pages) {
+    struct list written;
+    list_init(&written);
+    lock_acquire(&pagecache_lock);
+    struct hash_iterator i;
+    hash_first(&i, pages);
+    while (hash_next(&i)) {
+        struct page* page = hash_entry(hash_cur(&i), struct page, 
+                                       pages_elem);
+        if (!page->cached) {
+            continue;
+        }
+        // Eviction may unmap the page while we wait for another
+        // thread to write its entry back.
+        while (page->frame && page->frame->cache->io_thread &&
+               page->frame->cache->io_thread != thread_current()) {
+            cond_wait(&pagecache_io, &pagecache_lock);
+        }
+        if (!page->frame) {
+            continue;
+        }
+        struct pagecache_entry* entry = page->frame->cache;
+        if (pagedir_is_dirty(page->thread->pagedir, page->vaddr)) {
+            entry->dirty = true;
+        }
+        if (entry->dirty && page->type == PAGE_MMAP) {
+            if (entry->io_thread) {
+                // Another of our pages already queued it.
+                entry->dirty = false;
+            } else {
+                _pagecache_start_write(entry);
+                list_push_back(&written, &entry->io_elem);
+                page->thread->vm_stats.mmap_writebacks++;
+            }
+        }
+    }
+    // Mappers of cached frames only change while holding the cache.
+    frame_release_all(pages);
+    _pagecache_write_list(&written);
+    lock_release(&pagecache_lock);
+}
+
+/* Tries to evict the given page cache frame, called by the frame
+   allocator while it owns the frame lock. If the frame has not been
+   accessed since the last try, it is unmapped from all of its pages.
+   A clean frame is removed from the cache right away. A dirty one is
+   pinned and marked as being written back, and the caller must pass
+   it to pagecache_write_evicted once it let go of the frame lock.
+   Frames that are still mapped are only considered if MAPPED_OK is
+   true. */
+enum pagecache_evict
+pagecache_try_evict(struct frame* frame, bool mapped_ok) {
+    if (!mapped_ok && !list_empty(&frame->pages)) {
+        return PAGECACHE_KEPT;
+    }
+    // Never wait on the page cache while owning the frame lock.
+    if (!lock_try_acquire(&pagecache_lock)) {
+        return PAGECACHE_KEPT;
+    }
+    enum pagecache_evict result = PAGECACHE_KEPT;
+    struct pagecache_entry* entry = frame->cache;
+    bool accessed = entry->referenced;
+    entry->referenced = false;
+    // Unmap right after checking for writes, so none can be lost.
+    enum intr_level old_level = intr_disable();
+    for (struct list_elem* e = list_begin(&frame->pages);
+         e != list_end(&frame->pages); e = list_next(e)) {
+        struct page* page = list_entry(e, struct page, frame_elem);
+        uint32_t* pd = page->thread->pagedir;
+        if (pagedir_is_accessed(pd, page->vaddr)) {
+            accessed = true;
+            // Reset accessed state.
+            pagedir_set_accessed(pd, page->vaddr, false);
+        }
+        if (pagedir_is_dirty(pd, page->vaddr)) {
+            entry->dirty = true;
+        }
+    }
+    if (!accessed) {
+        frame_unmap(frame);
+    }
+    intr_set_level(old_level);
+    if (accessed) {
+        goto release;
+    }
+
+    if (entry->dirty) {
+        // Like _pagecache_start_write, but we own the frame lock.
+        entry->io_thread = thread_current();
+        entry->dirty = false;
+        frame->pin_cnt++;
+        result = PAGECACHE_WRITE;
+    } else {
+        _pagecache_remove(entry);
+        result = PAGECACHE_EVICTED;
+    }
+
+release:
+    lock_release(&pagecache_lock);
+    return result;
+}
+
+/* Writes back the CNT page cache FRAMES that pagecache_try_evict 
+   returned PAGECACHE_WRITE for, without holding any lock. Those that
+   weren't used or written again meanwhile are removed from the cache.
+   The frames stay pinned for the caller, which may free those that 
+   no longer have a cache entry. */
+void
+pagecache_write_evicted(struct frame** frames, size_t cnt) {
+    for (size_t i = 0; i < cnt; i++) {
+        _pagecache_write_back(frames[i]->cache);
+    }
+    lock_acquire(&pagecache_lock);
+    for (size_t i = 0; i < cnt; i++) {
+        struct pagecache_entry* entry = frames[i]->cache;
+        ASSERT(entry->io_thread == thread_current());
+        entry->io_thread = NULL;
+        if (list_empty(&frames[i]->pages) && !entry->dirty && 
+            !entry->referenced) {
+            _pagecache_remove(entry);
+        }
+    }
+    cond_broadcast(&pagecache_io, &pagecache_lock);
+    lock_release(&pagecache_lock);
+}
+
+/* Copies SIZE bytes at OFFSET in INODE into BUFFER if the page is
+   resident in the page cache. The range must not cross a page.
+   Returns true if the bytes were read from the cache. */
+bool
+pagecache_read(struct inode* inode, void* buffer, off_t size, off_t offset) {
+    ASSERT(offset / PGSIZE == (offset + size - 1) / PGSIZE);
+
+    lock_acquire(&pagecache_lock);
+    struct pagecache_entry* entry = NULL;
+    if (!hash_empty(&cache)) {
+        entry = _pagecache_find(inode, offset - offset % PGSIZE);
+    }
+    if (entry && entry->io_thread == thread_current()) {
+        // The page cache is reading its own data from disk.
+        entry = NULL;
+    } else if (entry && !entry->loaded) {
+        entry = _pagecache_find_loaded(inode, offset - offset % PGSIZE);
+    }
+    if (!entry) {
+        lock_release(&pagecache_lock);
+        return false;
+    }
+    entry->referenced = true;
+    // The buffer may fault, so copy with the frame pinned instead.
+    struct frame* frame = entry->frame;
+    frame_pin(frame);
+    lock_release(&pagecache_lock);
+
+    memcpy(buffer, frame->frame + offset % PGSIZE, size);
+
+    frame_unpin(frame);
+    return true;
+}
+
+/* Updates any resident page cache pages with the SIZE bytes in
+   BUFFER that were just written at OFFSET in INODE. */
+void
+pagecache_write(struct inode* inode, const void* buffer, off_t size,
+                off_t offset) {
+    while (size > 0) {
+        off_t page_ofs = offset % PGSIZE;
+        off_t chunk_size = PGSIZE - page_ofs < size ? PGSIZE - page_ofs : size;
+
+        lock_acquire(&pagecache_lock);
+        struct pagecache_entry* entry = NULL;
+        if (!hash_empty(&cache)) {
+            entry = _pagecache_find(inode, offset - page_ofs);
+        }
+        if (entry && entry->io_thread == thread_current()) {
+            // The page cache is writing its own data back to disk.
+            entry = NULL;
+        } else if (entry && !entry->loaded) {
+            // Update the data once it is read, not before.
+            entry = _pagecache_find_loaded(inode, offset - page_ofs);
+        }
+        if (entry) {
+            // The buffer may fault, so copy with the frame pinned instead.
+            struct frame* frame = entry->frame;
+            frame_pin(frame);
+            lock_release(&pagecache_lock);
+
+            memcpy(frame->frame + page_ofs, buffer, chunk_size);
+
+            // A write back running meanwhile may have missed the data.
+            lock_acquire(&pagecache_lock);
+            entry = _pagecache_find(inode, offset - page_ofs);
+            if (entry && entry->io_thread) {
+                entry->dirty = true;
+            }
+            lock_release(&pagecache_lock);
+            frame_unpin(frame);
+        } else {
+            lock_release(&pagecache_lock);
+        }
+
+        size -= chunk_size;
+        offset += chunk_size;
+        buffer += chunk_size;
+    }
+}
+
+/* Writes back and frees every cached page of the given inode, called
+   once its last opener closes it. No page can still be mapping the
+   inode at this point, since mapped pages keep their file open. */
+void
+pagecache_drop_inode(struct inode* inode) {
+    lock_acquire(&pagecache_lock);
+    for (;;) {
+        // Can't remove entries while iterating, so collect first.
+        struct list dropped;
+        list_init(&dropped);
+        bool busy = false;
+        struct pagecache_file* file = _pagecache_find_file(inode);
+        struct list_elem* e = file ? list_begin(&file->entries) : NULL;
+        for (; file && e != list_end(&file->entries); e = list_next(e)) {
+            struct pagecache_entry* entry = list_entry(e, 
+                                                       struct pagecache_entry,
+                                                       file_elem);
+            if (entry->io_thread) {
+                busy = true;
+            } else {
+                list_push_back(&dropped, &entry->io_elem);
+            }
+        }
+        if (list_empty(&dropped) && !busy) {
+            break;
+        }
+
+        // Clean pages are freed right away, dirty ones are written 
+        // back first and freed by the next pass.
+        struct list written;
+        list_init(&written);
+        while (!list_empty(&dropped)) {
+            struct pagecache_entry* entry = list_entry(
+                list_pop_front(&dropped), struct pagecache_entry, io_elem);
+            struct frame* frame = entry->frame;
+            ASSERT(list_empty(&frame->pages));
+            if (entry->dirty) {
+                _pagecache_start_write(entry);
+                list_push_back(&written, &entry->io_elem);
+            } else {
+                _pagecache_remove(entry);
+                frame_free(frame);
+            }
+        }
+        if (!list_empty(&written)) {
+            _pagecache_write_list(&written);
+        } else {
+            cond_wait(&pagecache_io, &pagecache_lock);
+        }
+    }
+    lock_release(&pagecache_lock);
+}
+
+/* Returns the cached pages of INODE, or NULL if none are cached. */
+static struct pagecache_file*
+_pagecache_find_file(struct inode* inode) {
+    ASSERT(lock_held_by_current_thread(&pagecache_lock));
+
+    struct pagecache_file find_file;
+    find_file.inode = inode;
+    struct hash_elem* file = hash_find(&files, &find_file.files_elem);
+    if (!file) {
+        return NULL;
+    }
+    return hash_entry(file, struct pagecache_file, files_elem);
+}
+
+static struct pagecache_entry*
+_pagecache_find(struct inode* inode, off_t offset) {
+    ASSERT(lock_held_by_current_thread(&pagecache_lock));
+
+    struct pagecache_entry find_entry;
+    find_entry.inode = inode;
+    find_entry.offset = offset;
+    struct hash_elem* entry = hash_find(&cache, &find_entry.cache_elem);
+    if (!entry) {
+        return NULL;
+    }
+    return hash_entry(entry, struct pagecache_entry, cache_elem);
+}
+
+/* Like _pagecache_find, but waits for another thread to finish 
+   loading the entry first. */
+static struct pagecache_entry*
+_pagecache_find_loaded(struct inode* inode, off_t offset) {
+    for (;;) {
+        struct pagecache_entry* entry = _pagecache_find(inode, offset);
+        if (!entry || entry->loaded) {
+            return entry;
+        }
+        ASSERT(entry->io_thread != thread_current());
+        cond_wait(&pagecache_io, &pagecache_lock);
+    }
+}
+
+/* Adds an entry for the page at OFFSET in INODE to the page cache, 
+   owning the given pinned FRAME. The current thread must read the 
+   data in with _pagecache_read_in, and end the I/O, before the frame
+   is used. Returns the new entry, or NULL on failure. */
+static struct pagecache_entry*
+_pagecache_insert(struct inode* inode, off_t offset, struct frame* frame) {
+    ASSERT(lock_held_by_current_thread(&pagecache_lock));
+
+    struct pagecache_entry* entry = malloc(sizeof(struct pagecache_entry));
+    if (!entry) {
+        return NULL;
+    }
+    struct pagecache_file* file = _pagecache_find_file(inode);
+    if (!file) {
+        file = malloc(sizeof(struct pagecache_file));
+        if (!file) {
+            free(entry);
+            return NULL;
+        }
+        file->inode = inode;
+        list_init(&file->entries);
+        hash_insert(&files, &file->files_elem);
+    }
+    list_push_back(&file->entries, &entry->file_elem);
+    entry->file = file;
+    entry->inode = inode;
+    entry->offset = offset;
+    entry->frame = frame;
+    entry->dirty = false;
+    entry->referenced = false;
+    // Inserting before reading keeps concurrent writes from being
+    // lost, since they wait for the data and update it after.
+    entry->loaded = false;
+    entry->io_thread = thread_current();
+    hash_insert(&cache, &entry->cache_elem);
+    frame_set_cache(frame, entry);
+    return entry;
+}
+
+/* Reads the data of the newly inserted ENTRY from its inode, without
+   holding the page cache. */
+static void
+_pagecache_read_in(struct pagecache_entry* entry) {
+    ASSERT(entry->io_thread == thread_current());
+    ASSERT(!lock_held_by_current_thread(&pagecache_lock));
+
+    struct frame* frame = entry->frame;
+    off_t length = inode_read_at(entry->inode, frame->frame, PGSIZE, 
+                                 entry->offset);
+    if (length < PGSIZE) {
+        memset(frame->frame + length, 0, PGSIZE - length);
+    }
+}
+
+/* Marks the given dirty entry as being written back by the current
+   thread, which keeps others from removing it. Writes made to it
+   from now on make it dirty again. */
+static void
+_pagecache_start_write(struct pagecache_entry* entry) {
+    ASSERT(lock_held_by_current_thread(&pagecache_lock));
+    ASSERT(!entry->io_thread);
+
+    entry->io_thread = thread_current();
+    entry->dirty = false;
+    frame_pin(entry->frame);
+}
+
+/* Writes back the ENTRIES the current thread started writing, 
+   letting go of the page cache meanwhile, and ends their I/O. */
+static void
+_pagecache_write_list(struct list* entries) {
+    ASSERT(lock_held_by_current_thread(&pagecache_lock));
+
+    if (list_empty(entries)) {
+        return;
+    }
+    lock_release(&pagecache_lock);
+    for (struct list_elem* e = list_begin(entries); e != list_end(entries);
+         e = list_next(e)) {
+        _pagecache_write_back(list_entry(e, struct pagecache_entry, io_elem));
+    }
+    lock_acquire(&pagecache_lock);
+    while (!list_empty(entries)) {
+        _pagecache_end_io(list_entry(list_pop_front(entries), 
+                                     struct pagecache_entry, io_elem));
+    }
+}
+
+/* Writes the cached page back to its inode. Data past the end of the
+   file is never written back, so the file doesn't grow. */
+static void
+_pagecache_write_back(struct pagecache_entry* entry) {
+    ASSERT(entry->io_thread == thread_current());
+    ASSERT(!lock_held_by_current_thread(&pagecache_lock));
+
+    off_t length = inode_length(entry->inode) - entry->offset;
+    if (length > PGSIZE) {
+        length = PGSIZE;
+    }
+    if (length > 0) {
+        inode_write_at(entry->inode, entry->frame->frame, length,
+                       entry->offset);
+    }
+}
+
+/* Ends the current thread's reading or writing back of ENTRY, waking
+   up those waiting for it. */
+static void
+_pagecache_end_io(struct pagecache_entry* entry) {
+    ASSERT(lock_held_by_current_thread(&pagecache_lock));
+    ASSERT(entry->io_thread == thread_current());
+
+    entry->io_thread = NULL;
+    entry->loaded = true;
+    frame_unpin(entry->frame);
+    cond_broadcast(&pagecache_io, &pagecache_lock);
+}
+
+/* Removes the given entry from the page cache and frees it, leaving
+   its frame to be freed by the caller. */
+static void
+_pagecache_remove(struct pagecache_entry* entry) {
+    ASSERT(lock_held_by_current_thread(&pagecache_lock));
+
+    hash_delete(&cache, &entry->cache_elem);
+    list_remove(&entry->file_elem);
+    if (list_empty(&entry->file->entries)) {
+        hash_delete(&files, &entry->file->files_elem);
+        free(entry->file);
+    }
+    entry->frame->cache = NULL;
+    free(entry);
+}
+
+static unsigned
+pagecache_hash_func(const struct hash_elem *e, void *aux UNUSED) {
+  struct pagecache_entry *entry = hash_entry(e, struct pagecache_entry,
+                                             cache_elem);
+  return hash_int((int) entry->inode) ^ hash_int(entry->offset);
+}
+
+static bool
+pagecache_less_func(const struct hash_elem *_a, const struct hash_elem *_b,
+                    void *aux UNUSED) {
+  struct pagecache_entry *a = hash_entry(_a, struct pagecache_entry,
+                                         cache_elem);
+  struct pagecache_entry *b = hash_entry(_b, struct pagecache_entry,
+                                         cache_elem);
+  if (a->inode != b->inode) {
+    return a->inode < b->inode;
+  }
+  return a->offset < b->offset;
+}
+
+static unsigned
+file_hash_func(const struct hash_elem *e, void *aux UNUSED) {
+  struct pagecache_file *file = hash_entry(e, struct pagecache_file,
+                                           files_elem);
+  return hash_int((int) file->inode);
+}
+
+static bool
+file_less_func(const struct hash_elem *_a, const struct hash_elem *_b,
+               void *aux UNUSED) {
+  struct pagecache_file *a = hash_entry(_a, struct pagecache_file,
+                                        files_elem);
+  struct pagecache_file *b = hash_entry(_b, struct pagecache_file,
+                                        files_elem);
+  return a->inode < b->inode;
+}
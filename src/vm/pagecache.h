@@ -0,0 +1,56 @@
+#ifndef VM_PAGECACHE_H
+#define VM_PAGECACHE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include "filesys/inode.h"
+#include "filesys/off_t.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+struct pagecache_file;
+
+/* A page of file data held in a frame, shared by every mapper of
+   the same (inode, page offset) and consulted by file reads. */
+struct pagecache_entry {
+    struct inode* inode;         /* The inode this page caches. */
+    struct pagecache_file* file; /* The cached pages of the inode. */
+    off_t offset;                /* The page aligned offset in the inode. */
+    struct frame* frame;         /* The frame holding the file data. */
+    bool dirty;                  /* Whether an unmapped mapper wrote to it. */
+    bool referenced;             /* Whether it was used since last scan. */
+    bool loaded;                 /* Whether the frame holds the data yet. */
+    struct thread* io_thread;    /* The thread reading or writing back the
+                                    data without holding the page cache,
+                                    or NULL. */
+
+    struct hash_elem cache_elem; /* The hash elem for the page cache. */
+    struct list_elem file_elem;  /* The list elem for the inode's pages. */
+    struct list_elem io_elem;    /* The list elem for entries to write. */
+};
+
+/* The outcome of trying to evict a page cache frame. */
+enum pagecache_evict {
+    PAGECACHE_KEPT,      /* The frame stays in the cache. */
+    PAGECACHE_EVICTED,   /* The frame left the cache, and may be freed. */
+    PAGECACHE_WRITE,     /* The frame must be written back first. */
+};
+
+void pagecache_init(void);
+void pagecache_writeback_init(void);
+void pagecache_tick(void);
+void pagecache_sync(struct inode* inode);
+bool pagecache_load(struct page* page, bool speculative);
+void pagecache_release(struct page* page);
+void pagecache_release_all(struct hash* pages);
+enum pagecache_evict pagecache_try_evict(struct frame* frame, 
+                                         bool mapped_ok);
+void pagecache_write_evicted(struct frame** frames, size_t cnt);
+bool pagecache_read(struct inode* inode, void* buffer, off_t size,
+                    off_t offset);
+void pagecache_write(struct inode* inode, const void* buffer, off_t size,
+                     off_t offset);
+void pagecache_drop_inode(struct inode* inode);
+
+#endif /* vm/pagecache.h */
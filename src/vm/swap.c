@@ -1,78 +1,204 @@
 #include "vm/swap.h"
+#include <bitmap.h>
+#include <stdint.h>
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/zswap.h"
 #include <stdio.h>
 #include <string.h>
 
-#define SECTORS_NEEDED PGSIZE/BLOCK_SECTOR_SIZE
+#define SECTORS_NEEDED (PGSIZE / BLOCK_SECTOR_SIZE)
 
 struct block* swap;
-static void* buffer;
-static block_sector_t explored_sector = 0;
-static block_sector_t free_sector = 0;
+/* One bit per page sized swap slot, set if the slot is in use. */
+static struct bitmap* slots;
+/* The page stored in each used slot, for reading back neighbours, or
+   NULL if the slot is shared. */
+static struct page** slot_pages;
+/* The count of pages sharing each used slot, after fork. */
+static uint16_t* slot_refs;
+/* Where the next search for a free slot starts, so that pages
+   written one after another land in adjacent slots. */
+static size_t next_slot = 0;
 static struct lock swap_lock;
 
+static size_t _swap_alloc(size_t cnt);
+static void _swap_free_slot(size_t slot);
+
 void
 swap_init() {
     swap = block_get_role(BLOCK_SWAP);
-    buffer = palloc_get_page(0);
+    size_t slot_cnt = swap ? block_size(swap) / SECTORS_NEEDED : 0;
+    slots = bitmap_create(slot_cnt);
+    slot_pages = calloc(slot_cnt, sizeof(struct page*));
+    slot_refs = calloc(slot_cnt, sizeof(uint16_t));
+    if (!slots || ((!slot_pages || !slot_refs) && slot_cnt > 0)) {
+        PANIC("Can't allocate swap slot bitmap!");
+    }
     lock_init(&swap_lock);
 }
 
-block_sector_t 
-swap_write(struct frame* frame) {
+/* Writes the CNT frames of the given pages to swap, storing the
+   sector of each page in SECTORS. The pages get adjacent slots when 
+   there is a free run long enough, so they can be read back 
+   together. */
+void
+swap_write(struct page** pages, struct frame** frames, size_t cnt,
+           block_sector_t* sectors) {
+    ASSERT(cnt <= SWAP_CLUSTER);
+
     lock_acquire(&swap_lock);
-    if (free_sector + SECTORS_NEEDED >= block_size(swap)) {
-        PANIC("Out of swap memory!");
+    size_t slot = _swap_alloc(cnt);
+    for (size_t i = 0; i < cnt; i++) {
+        // Fall back to any free slots once swap is fragmented.
+        size_t page_slot = slot != BITMAP_ERROR ? slot + i : _swap_alloc(1);
+        if (page_slot == BITMAP_ERROR) {
+            PANIC("Out of swap memory!");
+        }
+        slot_pages[page_slot] = pages[i];
+        slot_refs[page_slot] = 1;
+        sectors[i] = page_slot * SECTORS_NEEDED;
     }
+    lock_release(&swap_lock);
 
-    block_sector_t sector = explored_sector;
-    // If a sector was freed, use it first.
-    if (free_sector < explored_sector) {
-        sector = free_sector;
-        // Read the next free sector from the free block.
-        block_read(swap, free_sector, buffer);
-        free_sector = *((block_sector_t*) buffer);
-    } else {
-        // If the next free sector is the farthest explored, keep exploring.
-        free_sector += SECTORS_NEEDED;
-        explored_sector += SECTORS_NEEDED;
+    // The slots are ours now, so they can be written without the lock.
+    // Pages that compress well stay in memory, in the swap cache.
+    for (size_t i = 0; i < cnt; i++) {
+        if (zswap_store(sectors[i] / SECTORS_NEEDED, frames[i]->frame)) {
+            continue;
+        }
+        for (size_t j = 0; j < SECTORS_NEEDED; j++) {
+            block_write(swap, sectors[i] + j, 
+                        frames[i]->frame + BLOCK_SECTOR_SIZE * j);
+        }
     }
+}
 
-    for (size_t i = 0; i < SECTORS_NEEDED; i++) {
-        block_write(swap, sector + i, frame->frame + BLOCK_SECTOR_SIZE * i);
-    }
+/* Finds and marks CNT adjacent free slots, searching from where the 
+   last search ended. Returns the first slot, or BITMAP_ERROR. */
+static size_t
+_swap_alloc(size_t cnt) {
+    ASSERT(lock_held_by_current_thread(&swap_lock));
 
-    lock_release(&swap_lock);
-    return sector;
+    size_t slot = bitmap_scan_and_flip(slots, next_slot, cnt, false);
+    if (slot == BITMAP_ERROR) {
+        // Wrap around to the slots freed behind the search.
+        slot = bitmap_scan_and_flip(slots, 0, cnt, false);
+    }
+    if (slot != BITMAP_ERROR) {
+        next_slot = slot + cnt;
+    }
+    return slot;
 }
 
 /* Allocates a new frame and reads the data from the given swap sector 
    into the frame. */
 struct frame* 
 swap_read(block_sector_t sector) {
-    // Note: This frame can't be de-allocated until placed into a page.
+    // The frame is returned pinned, so it stays put until placed into
+    // a page.
     struct frame* frame = frame_allocate();
     if (!frame) {
         return NULL;
     }
+    // Other pages sharing the slot still need the cached copy.
     lock_acquire(&swap_lock);
-    for (size_t i = 0; i < SECTORS_NEEDED; i++) {
-        block_read(swap, sector + i, frame->frame + BLOCK_SECTOR_SIZE * i);
+    bool shared = slot_refs[sector / SECTORS_NEEDED] > 1;
+    lock_release(&swap_lock);
+    if (!zswap_load(sector / SECTORS_NEEDED, frame->frame, !shared)) {
+        for (size_t i = 0; i < SECTORS_NEEDED; i++) {
+            block_read(swap, sector + i, 
+                       frame->frame + BLOCK_SECTOR_SIZE * i);
+        }
     }
 
-    lock_release(&swap_lock);
+    // The slot is freed, so the frame holds the only copy.
+    frame->dirty = true;
     swap_free(sector);
     return frame;
 }
 
+/* Returns the page of the current process stored DELTA slots away
+   from the given sector, or NULL if that slot is out of range, free, 
+   or holds another process's page. */
+struct page*
+swap_neighbour(block_sector_t sector, int delta) {
+    int slot = (int) (sector / SECTORS_NEEDED) + delta;
+    if (slot < 0 || (size_t) slot >= bitmap_size(slots)) {
+        return NULL;
+    }
+    lock_acquire(&swap_lock);
+    // Pages free their slot before being freed, so the page can still
+    // be looked at while the swap lock is held.
+    struct page* page = bitmap_test(slots, slot) ? slot_pages[slot] : NULL;
+    if (page && page->thread != thread_current()) {
+        page = NULL;
+    }
+    lock_release(&swap_lock);
+    return page;
+}
+
+/* Adds another page to the pages sharing the swap slot starting at
+   the given sector, which is then freed once all of them free it. */
+void
+swap_share(block_sector_t sector) {
+    ASSERT(sector % SECTORS_NEEDED == 0);
+    size_t slot = sector / SECTORS_NEEDED;
+
+    lock_acquire(&swap_lock);
+    ASSERT(bitmap_test(slots, slot));
+    ASSERT(slot_refs[slot] < UINT16_MAX);
+    slot_refs[slot]++;
+    // The first page may now be freed before the slot, and read-ahead
+    // only needs the pages of a single process anyway.
+    slot_pages[slot] = NULL;
+    lock_release(&swap_lock);
+}
+
+/* Frees the swap slot starting at the given sector, once no other 
+   page shares it. */
 void 
 swap_free(block_sector_t sector) {
+    ASSERT(sector % SECTORS_NEEDED == 0);
+    size_t slot = sector / SECTORS_NEEDED;
+
     lock_acquire(&swap_lock);
-    *((block_sector_t*) buffer) = free_sector;
-    block_write(swap, sector, buffer);
+    _swap_free_slot(slot);
+    lock_release(&swap_lock);
+}
 
-    free_sector = sector;
+/* Frees the swap slots of every swapped page of PAGES, the page table
+   of an exiting process, while holding the swap lock once. */
+void
+swap_free_all(struct hash* pages) {
+    lock_acquire(&swap_lock);
+    struct hash_iterator i;
+    hash_first(&i, pages);
+    while (hash_next(&i)) {
+        struct page* page = hash_entry(hash_cur(&i), struct page, 
+                                       pages_elem);
+        if (page->swapped) {
+            ASSERT(page->swap_sector % SECTORS_NEEDED == 0);
+            _swap_free_slot(page->swap_sector / SECTORS_NEEDED);
+            page->swapped = false;
+        }
+    }
     lock_release(&swap_lock);
-}
\ No newline at end of file
+}
+
+/* Drops a reference to the given slot, freeing it once no page
+   shares it. */
+static void
+_swap_free_slot(size_t slot) {
+    ASSERT(lock_held_by_current_thread(&swap_lock));
+    ASSERT(bitmap_test(slots, slot));
+    if (--slot_refs[slot] == 0) {
+        // Drop any cached copy before the slot can be handed out again.
+        zswap_invalidate(slot);
+        bitmap_reset(slots, slot);
+        slot_pages[slot] = NULL;
+    }
+}
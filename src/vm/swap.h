@@ -4,9 +4,17 @@
 #include "vm/frame.h"
 #include "devices/block.h"
 
+/* The most pages evicted to adjacent swap slots at once, and read
+   back together on a swap-in fault. */
+#define SWAP_CLUSTER 8
+
 void swap_init(void);
-block_sector_t swap_write(struct frame* frame);
+void swap_write(struct page** pages, struct frame** frames, size_t cnt,
+                block_sector_t* sectors);
 struct frame* swap_read(block_sector_t sector);
+struct page* swap_neighbour(block_sector_t sector, int delta);
+void swap_share(block_sector_t sector);
 void swap_free(block_sector_t sector);
+void swap_free_all(struct hash* pages);
 
-#endif /* vm/swap.h */
\ No newline at end of file
+#endif /* vm/swap.h */
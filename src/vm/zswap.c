@@ -0,0 +1,218 @@
+#include "vm/zswap.h"
+#include <debug.h>
+#include <hash.h>
+#include <lz4.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A compressed page held in the swap cache in place of its swap 
+   slot. Entries are allocated with malloc, whose blocks come in 
+   power of two size classes up to 1 kB, so only pages compressing
+   into a block of at most that size are worth keeping. */
+struct zswap_entry {
+    size_t slot;             /* The swap slot this page belongs to. */
+    struct hash_elem elem;   /* The hash elem for the swap cache. */
+    uint16_t size;           /* The compressed size of the page. */
+    uint8_t data[];          /* The compressed page. */
+};
+
+/* The largest block malloc hands out from its size classes. */
+#define ZSWAP_MAX_BLOCK 1024
+/* The largest compressed page that is kept. */
+#define ZSWAP_MAX_SIZE (ZSWAP_MAX_BLOCK - sizeof(struct zswap_entry))
+
+/* The compressed pages, keyed by swap slot. */
+static struct hash entries;
+/* The most bytes the swap cache may use, 0 if it is disabled. */
+static size_t limit;
+/* The bytes currently used by the swap cache, counting whole blocks. */
+static size_t used;
+/* Scratch memory for compressing, and the output buffer. */
+static void* work;
+static uint8_t* buffer;
+/* Aquired whenever the swap cache is accessed. Never held while 
+   doing I/O, but may be aquired while holding the swap lock. */
+static struct lock zswap_lock;
+
+/* Statistics. */
+static unsigned long long stored_cnt;   /* Pages stored. */
+static unsigned long long rejected_cnt; /* Pages sent to disk. */
+static unsigned long long hit_cnt;      /* Loads served from memory. */
+static unsigned long long miss_cnt;     /* Loads left to the disk. */
+static unsigned long long stored_bytes; /* Compressed bytes stored. */
+
+static size_t _zswap_block_size(size_t size);
+static struct zswap_entry* _zswap_find(size_t slot);
+static struct zswap_entry* _zswap_remove(size_t slot);
+static unsigned zswap_hash_func(const struct hash_elem *e, void *aux UNUSED);
+static bool zswap_less_func(const struct hash_elem *_a, 
+                            const struct hash_elem *_b, void *aux UNUSED);
+
+/* Sets up a swap cache of at most LIMIT_PAGES kernel pages. A limit
+   of 0 disables it. */
+void
+zswap_init(size_t limit_pages) {
+    hash_init(&entries, zswap_hash_func, zswap_less_func, NULL);
+    lock_init(&zswap_lock);
+    limit = limit_pages * PGSIZE;
+    used = 0;
+    if (limit > 0) {
+        work = malloc(LZ4_WORK_SIZE);
+        buffer = malloc(ZSWAP_MAX_SIZE);
+        if (!work || !buffer) {
+            PANIC("Can't allocate the swap cache!");
+        }
+    }
+}
+
+/* Compresses the given page into the swap cache in place of the 
+   given swap slot. Returns false if the page doesn't compress well 
+   or the cache is full, in which case it must go to disk. */
+bool
+zswap_store(size_t slot, const void* page) {
+    if (limit == 0) {
+        return false;
+    }
+    lock_acquire(&zswap_lock);
+    struct zswap_entry* entry = NULL;
+    size_t size = lz4_compress(page, PGSIZE, buffer, ZSWAP_MAX_SIZE, work);
+    if (size > 0) {
+        size_t block_size = _zswap_block_size(sizeof *entry + size);
+        if (used + block_size <= limit) {
+            entry = malloc(sizeof *entry + size);
+        }
+        if (entry) {
+            entry->slot = slot;
+            entry->size = size;
+            memcpy(entry->data, buffer, size);
+            hash_insert(&entries, &entry->elem);
+            used += block_size;
+            stored_cnt++;
+            stored_bytes += size;
+        }
+    }
+    if (!entry) {
+        rejected_cnt++;
+    }
+    lock_release(&zswap_lock);
+    return entry != NULL;
+}
+
+/* Decompresses the page stored for the given swap slot into PAGE, 
+   and drops it from the swap cache if DROP is true. Returns false if
+   the page isn't in the cache, in which case it is on disk. */
+bool
+zswap_load(size_t slot, void* page, bool drop) {
+    if (limit == 0) {
+        return false;
+    }
+    lock_acquire(&zswap_lock);
+    struct zswap_entry* entry = drop ? _zswap_remove(slot) 
+                                     : _zswap_find(slot);
+    if (entry) {
+        hit_cnt++;
+    } else {
+        miss_cnt++;
+    }
+    // A kept entry could be dropped by another process meanwhile.
+    size_t size = 0;
+    if (entry && !drop) {
+        size = lz4_decompress(entry->data, entry->size, page, PGSIZE);
+    }
+    lock_release(&zswap_lock);
+    if (!entry) {
+        return false;
+    }
+
+    if (drop) {
+        size = lz4_decompress(entry->data, entry->size, page, PGSIZE);
+        free(entry);
+    }
+    if (size != PGSIZE) {
+        PANIC("Corrupt page in the swap cache!");
+    }
+    return true;
+}
+
+/* Drops the page stored for the given swap slot, if there is one. */
+void
+zswap_invalidate(size_t slot) {
+    if (limit == 0) {
+        return;
+    }
+    lock_acquire(&zswap_lock);
+    struct zswap_entry* entry = _zswap_remove(slot);
+    lock_release(&zswap_lock);
+    free(entry);
+}
+
+void
+zswap_print_stats() {
+    if (limit == 0) {
+        return;
+    }
+    unsigned long long ratio = stored_cnt > 0 
+        ? stored_bytes * 100 / (stored_cnt * PGSIZE) : 0;
+    printf("Swap cache: %llu pages stored at %llu%% size, %llu rejected, "
+           "%llu hits, %llu misses\n",
+           stored_cnt, ratio, rejected_cnt, hit_cnt, miss_cnt);
+}
+
+/* Returns the size of the malloc block holding SIZE bytes. */
+static size_t
+_zswap_block_size(size_t size) {
+    size_t block_size = 16;
+    while (block_size < size) {
+        block_size *= 2;
+    }
+    return block_size;
+}
+
+/* Returns the entry for the given slot, or NULL if there is none. */
+static struct zswap_entry*
+_zswap_find(size_t slot) {
+    ASSERT(lock_held_by_current_thread(&zswap_lock));
+
+    struct zswap_entry find_entry;
+    find_entry.slot = slot;
+    struct hash_elem* e = hash_find(&entries, &find_entry.elem);
+    if (!e) {
+        return NULL;
+    }
+    return hash_entry(e, struct zswap_entry, elem);
+}
+
+/* Removes the entry for the given slot from the swap cache and 
+   returns it, or NULL if there is none. */
+static struct zswap_entry*
+_zswap_remove(size_t slot) {
+    ASSERT(lock_held_by_current_thread(&zswap_lock));
+
+    struct zswap_entry find_entry;
+    find_entry.slot = slot;
+    struct hash_elem* e = hash_delete(&entries, &find_entry.elem);
+    if (!e) {
+        return NULL;
+    }
+    struct zswap_entry* entry = hash_entry(e, struct zswap_entry, elem);
+    used -= _zswap_block_size(sizeof *entry + entry->size);
+    return entry;
+}
+
+static unsigned
+zswap_hash_func(const struct hash_elem *e, void *aux UNUSED) {
+  struct zswap_entry *entry = hash_entry(e, struct zswap_entry, elem);
+  return hash_int(entry->slot);
+}
+
+static bool
+zswap_less_func(const struct hash_elem *_a, const struct hash_elem *_b,
+                void *aux UNUSED) {
+  struct zswap_entry *a = hash_entry(_a, struct zswap_entry, elem);
+  struct zswap_entry *b = hash_entry(_b, struct zswap_entry, elem);
+  return a->slot < b->slot;
+}
@@ -0,0 +1,16 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* The default size of the compressed swap cache, in kernel pages. */
+#define ZSWAP_DEFAULT_PAGES 32
+
+void zswap_init(size_t limit_pages);
+bool zswap_store(size_t slot, const void* page);
+bool zswap_load(size_t slot, void* page, bool drop);
+void zswap_invalidate(size_t slot);
+void zswap_print_stats(void);
+
+#endif /* vm/zswap.h */